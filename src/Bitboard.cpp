@@ -0,0 +1,216 @@
+#include "Bitboard.h"
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#if defined(CHESSCPP_HAS_PEXT) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+using namespace ChessCpp;
+
+bool Bitboards::USE_PEXT = false;
+Bitboards::Magic Bitboards::BISHOP_MAGICS[64];
+Bitboards::Magic Bitboards::ROOK_MAGICS[64];
+Bitboard Bitboards::PAWN_ATTACKS[2][64];
+Bitboard Bitboards::KNIGHT_ATTACKS[64];
+Bitboard Bitboards::KING_ATTACKS[64];
+Bitboard Bitboards::BETWEEN[64][64];
+Bitboard Bitboards::LINE[64][64];
+
+namespace {
+	// Ray directions as (file, row) steps. Row 0 is the 8th rank, so "north" decreases the row.
+	const int DIRECTION_STEPS[8][2] = {
+		{ 0, -1 },  // N
+		{ 1, -1 },  // NE
+		{ 1, 0 },   // E
+		{ 1, 1 },   // SE
+		{ 0, 1 },   // S
+		{ -1, 1 },  // SW
+		{ -1, 0 },  // W
+		{ -1, -1 }  // NW
+	};
+
+	const int BISHOP_DIRECTIONS[4] = { 1, 3, 5, 7 };
+	const int ROOK_DIRECTIONS[4] = { 0, 2, 4, 6 };
+
+	// Shared attack tables for all squares; sizes are the sums of 2^(relevant bits) per square.
+	Bitboard BISHOP_TABLE[0x1480];
+	Bitboard ROOK_TABLE[0x19000];
+
+	Bitboard stepAttacks(int sq, const int (*steps)[2], int count) {
+		Bitboard result = 0;
+		const int f = sq & 7;
+		const int r = sq >> 3;
+		for (int i = 0; i < count; i++) {
+			const int nf = f + steps[i][0];
+			const int nr = r + steps[i][1];
+			if (nf >= 0 && nf < 8 && nr >= 0 && nr < 8) {
+				result |= 1ULL << (nr * 8 + nf);
+			}
+		}
+		return result;
+	}
+
+	// Slow ray walk, used only while filling the lookup tables.
+	Bitboard slidingAttacks(const int (&dirs)[4], int sq, Bitboard occupied) {
+		Bitboard result = 0;
+		for (int dir : dirs) {
+			int f = (sq & 7) + DIRECTION_STEPS[dir][0];
+			int r = (sq >> 3) + DIRECTION_STEPS[dir][1];
+			while (f >= 0 && f < 8 && r >= 0 && r < 8) {
+				const Bitboard b = 1ULL << (r * 8 + f);
+				result |= b;
+				if (occupied & b) break;
+				f += DIRECTION_STEPS[dir][0];
+				r += DIRECTION_STEPS[dir][1];
+			}
+		}
+		return result;
+	}
+
+	// Squares whose occupancy matters for a slider on sq: its rays without the board edge.
+	Bitboard relevantMask(const int (&dirs)[4], int sq) {
+		const Bitboard edges =
+			((RANK_8_BB | RANK_1_BB) & ~(RANK_8_BB << (8 * (sq >> 3)))) |
+			((FILE_A_BB | FILE_H_BB) & ~(FILE_A_BB << (sq & 7)));
+		return slidingAttacks(dirs, sq, 0) & ~edges;
+	}
+
+	// Multipliers for this square layout (a8 = 0), found offline with a sparse random search.
+	const Bitboard BISHOP_MAGIC_NUMBERS[64] = {
+		0x40106000A1160020ULL, 0x0230106090808800ULL, 0x4010210041000800ULL, 0x02240400980C2000ULL,
+		0x1304030800402088ULL, 0x140A0F1008000002ULL, 0x0001043002088080ULL, 0x0431240044102800ULL,
+		0x0000400222021200ULL, 0x0040080880809206ULL, 0x0420044104250001ULL, 0x0008841046010A40ULL,
+		0x2000020210001000ULL, 0x4000C20190080000ULL, 0x0404020801041004ULL, 0x0004004048241040ULL,
+		0x8008802002104A20ULL, 0x08080802B0840080ULL, 0x1008082A42040020ULL, 0x2118010402142012ULL,
+		0x2002800400A08004ULL, 0x2108080082012020ULL, 0x2054038069080800ULL, 0x0000400202020110ULL,
+		0x0230404825040481ULL, 0x1030310108012102ULL, 0x8808020A11140105ULL, 0x0014040038020808ULL,
+		0x2084040018410040ULL, 0x8409420001C11030ULL, 0x000088904C020830ULL, 0x00032A0401420080ULL,
+		0xA204824014602422ULL, 0xC9021A1308E00824ULL, 0x0404020100420400ULL, 0x2800600800048820ULL,
+		0x00084A0020120080ULL, 0x00041000800C1040ULL, 0x2004081880004400ULL, 0x0042040031250091ULL,
+		0xC20A082008004400ULL, 0x1124010882122800ULL, 0x8842010101002081ULL, 0x4001044200808808ULL,
+		0x0000240102122400ULL, 0x3082240806020221ULL, 0x803010B218808040ULL, 0x1034A40400400020ULL,
+		0x4081040120690000ULL, 0x00420A12090C8500ULL, 0x0808420124090940ULL, 0x1110050042020001ULL,
+		0x0D60224099024000ULL, 0x0100084218820081ULL, 0x08882048088504A8ULL, 0x2406088F01060390ULL,
+		0x000202010C829000ULL, 0x0260010421010810ULL, 0x0004200A004208A0ULL, 0x0222000800208821ULL,
+		0x0083040004104421ULL, 0x2011808810100224ULL, 0x2102A02002208100ULL, 0x0002420441020602ULL
+	};
+
+	const Bitboard ROOK_MAGIC_NUMBERS[64] = {
+		0x0A80004000801220ULL, 0x10C0100040002000ULL, 0x0100102000410009ULL, 0x0B0021000C100008ULL,
+		0x4080080080040002ULL, 0x0200019004080200ULL, 0x0400080A10112684ULL, 0x20800A4D00062080ULL,
+		0x2091800020804000ULL, 0x0044401000200040ULL, 0x1001002000401108ULL, 0x1001800801100081ULL,
+		0x0001000500080010ULL, 0x1000808002000400ULL, 0x0404000482100108ULL, 0x0003000182610002ULL,
+		0x0440848002C00420ULL, 0x2010890040010021ULL, 0x8800110020044300ULL, 0x0208010100201000ULL,
+		0x1222020004102008ULL, 0x0000808002000400ULL, 0x20040400094A9008ULL, 0x0000420000804401ULL,
+		0x0040002880004680ULL, 0x0000200240100040ULL, 0x0020008180201001ULL, 0x01080080800C1000ULL,
+		0x0104040080800800ULL, 0x4800020080040080ULL, 0x0002000200840108ULL, 0x00A1000100006082ULL,
+		0x8004400088800260ULL, 0x0100804000802008ULL, 0x0010008010802002ULL, 0x000C801000800800ULL,
+		0x0C51800402800800ULL, 0x0002800200800400ULL, 0x0000820804000110ULL, 0x4003808042000401ULL,
+		0x00208020C0018000ULL, 0x4400402010004009ULL, 0x22100400A800E000ULL, 0x0E020021400A0013ULL,
+		0x10A0080100110005ULL, 0x0004010002004040ULL, 0x0024080102040010ULL, 0x4154089108420014ULL,
+		0x0182400080002380ULL, 0x0000400110802100ULL, 0x0000100080200480ULL, 0x100A000820401200ULL,
+		0x8081004020801002ULL, 0x0002000408100200ULL, 0x03223A1008010C00ULL, 0x000000831C014200ULL,
+		0x4200208009001041ULL, 0xC001004000881021ULL, 0x1008200100100841ULL, 0x0000082240920032ULL,
+		0x4002000804201102ULL, 0xB821000804000201ULL, 0x4080C208102100A4ULL, 0x02020900418C0CA2ULL
+	};
+
+	bool cpuHasFastPext() {
+#if defined(CHESSCPP_HAS_PEXT)
+		int regs[4] = { 0, 0, 0, 0 };
+		char vendor[13] = {};
+#if defined(_MSC_VER)
+		__cpuid(regs, 0);
+#else
+		__cpuid(0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		const int maxLeaf = regs[0];
+		std::memcpy(vendor, &regs[1], 4);
+		std::memcpy(vendor + 4, &regs[3], 4);
+		std::memcpy(vendor + 8, &regs[2], 4);
+		if (maxLeaf < 7) return false;
+
+#if defined(_MSC_VER)
+		__cpuidex(regs, 7, 0);
+#else
+		__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+		const bool bmi2 = (regs[1] & (1 << 8)) != 0;
+		if (!bmi2) return false;
+
+		// AMD implemented PEXT in microcode before Zen 3 (family 19h), which is slower than magics.
+		if (std::string(vendor) == "AuthenticAMD") {
+#if defined(_MSC_VER)
+			__cpuid(regs, 1);
+#else
+			__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+			const int family = ((regs[0] >> 8) & 0xF) + ((regs[0] >> 20) & 0xFF);
+			return family >= 0x19;
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	template <typename MagicT>
+	void initMagics(MagicT (&magics)[64], Bitboard* table, const Bitboard (&numbers)[64], const int (&dirs)[4]) {
+		Bitboard* next = table;
+
+		for (int sq = 0; sq < 64; sq++) {
+			MagicT& m = magics[sq];
+			m.mask = relevantMask(dirs, sq);
+			m.magic = numbers[sq];
+			m.shift = 64 - Bitboards::popCount(m.mask);
+			m.attacks = next;
+
+			// Walk every subset of the mask (Carry-Rippler) and store its attack set.
+			Bitboard b = 0;
+			do {
+				m.attacks[m.index(b)] = slidingAttacks(dirs, sq, b);
+				next++;
+				b = (b - m.mask) & m.mask;
+			} while (b);
+		}
+	}
+}
+
+void Bitboards::init() {
+	static std::once_flag once;
+	std::call_once(once, []() {
+		const int knightSteps[8][2] = { {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2} };
+		const int whitePawnSteps[2][2] = { {-1, -1}, {1, -1} };
+		const int blackPawnSteps[2][2] = { {-1, 1}, {1, 1} };
+
+		for (int sq = 0; sq < 64; sq++) {
+			PAWN_ATTACKS[static_cast<int>(WHITE)][sq] = stepAttacks(sq, whitePawnSteps, 2);
+			PAWN_ATTACKS[static_cast<int>(BLACK)][sq] = stepAttacks(sq, blackPawnSteps, 2);
+			KNIGHT_ATTACKS[sq] = stepAttacks(sq, knightSteps, 8);
+			KING_ATTACKS[sq] = stepAttacks(sq, DIRECTION_STEPS, 8);
+		}
+
+		USE_PEXT = cpuHasFastPext();
+		initMagics(BISHOP_MAGICS, BISHOP_TABLE, BISHOP_MAGIC_NUMBERS, BISHOP_DIRECTIONS);
+		initMagics(ROOK_MAGICS, ROOK_TABLE, ROOK_MAGIC_NUMBERS, ROOK_DIRECTIONS);
+
+		for (int a = 0; a < 64; a++) {
+			for (int b = 0; b < 64; b++) {
+				BETWEEN[a][b] = 0;
+				LINE[a][b] = 0;
+				if (a == b) continue;
+
+				const Bitboard ab = square(a) | square(b);
+				if (bishopAttacks(a, 0) & square(b)) {
+					LINE[a][b] = (bishopAttacks(a, 0) & bishopAttacks(b, 0)) | ab;
+					BETWEEN[a][b] = bishopAttacks(a, square(b)) & bishopAttacks(b, square(a));
+				}
+				else if (rookAttacks(a, 0) & square(b)) {
+					LINE[a][b] = (rookAttacks(a, 0) & rookAttacks(b, 0)) | ab;
+					BETWEEN[a][b] = rookAttacks(a, square(b)) & rookAttacks(b, square(a));
+				}
+			}
+		}
+	});
+}
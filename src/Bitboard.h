@@ -0,0 +1,183 @@
+#pragma once
+#include "../include/libtypes"
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// PEXT lookups are compiled in on x86-64 unless CHESSCPP_NO_PEXT is defined, and only used
+// when the CPU reports BMI2 at runtime.
+#if !defined(CHESSCPP_NO_PEXT) && (defined(_M_X64) || defined(__x86_64__))
+#define CHESSCPP_HAS_PEXT 1
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#endif
+#endif
+
+using namespace ChessCpp;
+
+// Bitboard primitives and precomputed attack tables.
+// Bit i of a bitboard is square i of the Square enum (a8 = 0, h1 = 63).
+class Bitboards {
+public:
+    /// Fills the attack tables. Safe to call more than once, and from several threads.
+    static void init();
+
+    static inline Bitboard square(int sq) {
+        return 1ULL << sq;
+    }
+
+    static inline int popCount(Bitboard b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        return static_cast<int>(__popcnt64(b));
+#elif defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(b);
+#else
+        int count = 0;
+        while (b) { b &= b - 1; count++; }
+        return count;
+#endif
+    }
+
+    /// Index of the least significant set bit. Undefined for an empty bitboard.
+    static inline int lsb(Bitboard b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long idx;
+        _BitScanForward64(&idx, b);
+        return static_cast<int>(idx);
+#elif defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(b);
+#else
+        int idx = 0;
+        while (!(b & 1)) { b >>= 1; idx++; }
+        return idx;
+#endif
+    }
+
+    /// Index of the most significant set bit. Undefined for an empty bitboard.
+    static inline int msb(Bitboard b) {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long idx;
+        _BitScanReverse64(&idx, b);
+        return static_cast<int>(idx);
+#elif defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(b);
+#else
+        int idx = 63;
+        while (!(b & (1ULL << 63))) { b <<= 1; idx--; }
+        return idx;
+#endif
+    }
+
+    /// Removes the least significant set bit from the bitboard and returns its index.
+    static inline int popLsb(Bitboard& b) {
+        const int sq = lsb(b);
+        b &= b - 1;
+        return sq;
+    }
+
+    static inline bool moreThanOne(Bitboard b) {
+        return (b & (b - 1)) != 0;
+    }
+
+    static inline Bitboard pawnAttacks(Color c, int sq) {
+        return PAWN_ATTACKS[static_cast<int>(c)][sq];
+    }
+
+    static inline Bitboard knightAttacks(int sq) {
+        return KNIGHT_ATTACKS[sq];
+    }
+
+    static inline Bitboard kingAttacks(int sq) {
+        return KING_ATTACKS[sq];
+    }
+
+    static inline Bitboard bishopAttacks(int sq, Bitboard occupied) {
+        const Magic& m = BISHOP_MAGICS[sq];
+        return m.attacks[m.index(occupied)];
+    }
+
+    static inline Bitboard rookAttacks(int sq, Bitboard occupied) {
+        const Magic& m = ROOK_MAGICS[sq];
+        return m.attacks[m.index(occupied)];
+    }
+
+    static inline Bitboard queenAttacks(int sq, Bitboard occupied) {
+        return bishopAttacks(sq, occupied) | rookAttacks(sq, occupied);
+    }
+
+    /// Attack set of a non-pawn piece standing on sq.
+    static inline Bitboard attacks(PieceSymbol p, int sq, Bitboard occupied) {
+        switch (p) {
+        case KNIGHT: return knightAttacks(sq);
+        case BISHOP: return bishopAttacks(sq, occupied);
+        case ROOK: return rookAttacks(sq, occupied);
+        case QUEEN: return queenAttacks(sq, occupied);
+        case KING: return kingAttacks(sq);
+        default: break;
+        }
+        return 0;
+    }
+
+    /// Squares strictly between a and b when they share a rank, file or diagonal, otherwise empty.
+    static inline Bitboard between(int a, int b) {
+        return BETWEEN[a][b];
+    }
+
+    /// The whole rank, file or diagonal through a and b, or empty when they are not aligned.
+    static inline Bitboard line(int a, int b) {
+        return LINE[a][b];
+    }
+
+    /// Pushes every pawn in the bitboard one rank forward for the given color.
+    static inline Bitboard pawnPush(Color c, Bitboard b) {
+        return c == WHITE ? b >> 8 : b << 8;
+    }
+
+    /// True when slider lookups are indexed with BMI2 PEXT instead of magic multiplication.
+    static inline bool usesPext() {
+        return USE_PEXT;
+    }
+
+private:
+    // Per-square lookup into the shared slider attack table.
+    struct Magic {
+        Bitboard mask;
+        Bitboard magic;
+        Bitboard* attacks;
+        unsigned shift;
+
+        inline unsigned index(Bitboard occupied) const {
+#ifdef CHESSCPP_HAS_PEXT
+            if (USE_PEXT) {
+                return static_cast<unsigned>(pext(occupied, mask));
+            }
+#endif
+            return static_cast<unsigned>(((occupied & mask) * magic) >> shift);
+        }
+    };
+
+#ifdef CHESSCPP_HAS_PEXT
+    static inline uint64_t pext(uint64_t src, uint64_t mask) {
+#if defined(_MSC_VER)
+        return _pext_u64(src, mask);
+#else
+        // Inline assembly so the rest of the library does not need to be built with -mbmi2.
+        uint64_t result;
+        __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(src), "r"(mask));
+        return result;
+#endif
+    }
+#endif
+
+    static bool USE_PEXT;
+    static Magic BISHOP_MAGICS[64];
+    static Magic ROOK_MAGICS[64];
+
+    static Bitboard PAWN_ATTACKS[2][64];
+    static Bitboard KNIGHT_ATTACKS[64];
+    static Bitboard KING_ATTACKS[64];
+    static Bitboard BETWEEN[64][64];
+    static Bitboard LINE[64][64];
+};
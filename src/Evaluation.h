@@ -0,0 +1,40 @@
+#pragma once
+#include "../include/libtypes"
+
+using namespace ChessCpp;
+
+// Tapered piece-square evaluation. A piece on a square is worth a middlegame and an endgame score, material
+// included, and the game phase (how much non-pawn material is left) blends the two. The per-square values are
+// signed, positive for White, so a position's terms are plain sums that can be updated as pieces move.
+class Evaluation {
+public:
+    /// Fills the tables. Safe to call more than once, and from several threads.
+    static void init();
+
+    /// Phase of the starting material; a position can exceed it after promotions.
+    static const int MAX_PHASE = 24;
+
+    static inline int middlegame(const Piece& p, int sq) {
+        return MIDDLEGAME[static_cast<int>(p.color)][static_cast<int>(p.type)][sq];
+    }
+
+    static inline int endgame(const Piece& p, int sq) {
+        return ENDGAME[static_cast<int>(p.color)][static_cast<int>(p.type)][sq];
+    }
+
+    static inline int phase(PieceSymbol type) {
+        return PHASE[static_cast<int>(type)];
+    }
+
+    /// Blends the two terms by phase and returns the score from the given side's view.
+    static inline int blend(int middlegame, int endgame, int phase, Color side) {
+        if (phase > MAX_PHASE) phase = MAX_PHASE;
+        const int score = (middlegame * phase + endgame * (MAX_PHASE - phase)) / MAX_PHASE;
+        return side == WHITE ? score : -score;
+    }
+
+private:
+    static int MIDDLEGAME[2][6][64];
+    static int ENDGAME[2][6][64];
+    static const int PHASE[6];
+};
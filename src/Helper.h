@@ -19,6 +19,22 @@ using namespace ChessCpp;
 
 bool operator<(Square lhs, Square rhs);
 
+// A FEN split into its fields and read in a single pass.
+struct ParsedFen {
+    std::array<Piece, 64> board;
+    Color turn = WHITE;
+    uint16_t castling = 0;
+    int epSquare = EMPTY;
+    int halfMoves = 0;
+    int moveNumber = 1;
+    int fields = 0;     // Fields present in the text, before any padding.
+};
+
+// Reads a FEN into out. With padMissing, a FEN with only its first two to five fields gets the
+// defaults "- - 0 1" for the rest. Returns nullptr on success, or the validateFen message for the
+// first problem found. Without validate only the field count and the counters are checked.
+const char* parseFen(const std::string& fen, ParsedFen& out, bool padMissing, bool validate);
+
 class Helper {
 public:
     static inline std::string trim(const std::string& str) {
@@ -73,75 +89,67 @@ public:
         return color == WHITE ? BLACK : WHITE;
     }
 
-    static inline std::string getDisambiguator(InternalMove move, std::vector<InternalMove> moves) {
-        const Square from = algebraic(move.from);
-        const Square to = algebraic(move.to);
-        const PieceSymbol p = move.piece;
-    
-        int ambiguities = 0;
-        int sameRank = 0;
-        int sameFile = 0;
-    
-        for (int i = 0; i < static_cast<int>(moves.size()); i++) {
-            const Square ambigFrom = algebraic(moves[i].from);
-            const Square ambigTo = algebraic(moves[i].to);
-            const PieceSymbol ambigPiece = moves[i].piece;
-    
-            if (!(p == ambigPiece && from != ambigFrom && to == ambigTo)) continue;
-    
-            ambiguities++;
-    
-            if (rank(Ox88.at((int)(from))) == rank(Ox88.at((int)(ambigFrom)))) {
-                sameRank++;
-            }
-            if (file(Ox88.at((int)(from))) == file(Ox88.at((int)(ambigFrom)))) {
-                sameFile++;
-            }
-        }
-        if (ambiguities <= 0) return "";
-    
-        if (sameRank > 0 && sameFile > 0) {
-            return squareToString(from);
+    /// What SAN adds after the piece letter to tell a move from the same move by a piece on one of the
+    /// rival squares: nothing, the file, the rank, or the whole square.
+    static inline std::string getDisambiguator(int from, Bitboard rivals) {
+        if (!rivals) return "";
+
+        const bool sameRank = (rivals & (RANK_8_BB << (from & 56))) != 0;
+        const bool sameFile = (rivals & (FILE_A_BB << (from & 7))) != 0;
+        const std::string square = squareToString(static_cast<Square>(from));
+
+        if (sameRank && sameFile) {
+            return square;
         }
-        else if (sameFile > 0) {
-            return std::string(1, squareToString(from).at(1));
+        else if (sameFile) {
+            return std::string(1, square.at(1));
         }
         else {
-            return std::string(1, squareToString(from).at(0));
+            return std::string(1, square.at(0));
         }
     }
 
-    static inline void addMove(std::vector<InternalMove>& moves, Color color, int from, int to, PieceSymbol p, PieceSymbol captured = PieceSymbol::NONE, int flags = BITS_NORMAL) {
-        const int r = rank(to);
+    static inline void addMove(MoveList& moves, int from, int to, PieceSymbol p, uint16_t kind = PackedMove::QUIET) {
+        const int r = to >> 3;
         if (p == PAWN && (r == RANK_1 || r == RANK_8)) {
             for (int i = 0; i < 4; i++) {
-                const PieceSymbol promotion = PROMOTIONS[i];
-                InternalMove promotionMove = {
-                    color,
-                    from,
-                    to,
-                    p,
-                    captured,
-                    promotion,
-                    flags |= BITS_PROMOTION
-                };
-                moves.push_back(promotionMove);
+                moves.push_back(PackedMove(from, to, kind | PackedMove::PROMOTION | i));
             }
         }
         else {
-            InternalMove normalMove = {
-                color,
-                from,
-                to,
-                p,
-                captured,
-                PieceSymbol::NONE,
-                flags
-            };
-            moves.push_back(normalMove);
+            moves.push_back(PackedMove(from, to, kind));
         }
     }
-    
+
+    /// Long algebraic (UCI) form of a move, e.g. "e2e4" or "e7e8q".
+    static inline std::string moveToLan(const PackedMove& move) {
+        std::string lan = squareToString(static_cast<Square>(move.from())) + squareToString(static_cast<Square>(move.to()));
+        if (move.isPromotion()) {
+            lan += pieceToChar(move.promotion());
+        }
+        return lan;
+    }
+
+    /// The FLAGS_* letters for a set of BITS_* flags, e.g. "cp" for a promotion with capture.
+    static inline std::string flagsToString(int flags) {
+        static const std::pair<int, char> NAMES[] = {
+            { BITS_NORMAL, FLAGS_NORMAL },
+            { BITS_CAPTURE, FLAGS_CAPTURE },
+            { BITS_BIG_PAWN, FLAGS_BIG_PAWN },
+            { BITS_EP_CAPTURE, FLAGS_EP_CAPTURE },
+            { BITS_PROMOTION, FLAGS_PROMOTION },
+            { BITS_KSIDE_CASTLE, FLAGS_KSIDE_CASTLE },
+            { BITS_QSIDE_CASTLE, FLAGS_QSIDE_CASTLE }
+        };
+        std::string result;
+        for (const auto& name : NAMES) {
+            if (flags & name.first) {
+                result += name.second;
+            }
+        }
+        return result;
+    }
+
     static inline std::string replaceSubstring(const std::string& str, const std::string& from, const std::string& to) {
         size_t startPos = str.find(from);
         if (startPos == std::string::npos) {
@@ -150,26 +158,90 @@ public:
         return str.substr(0, startPos) + to + str.substr(startPos + from.length());
     }
 
-    static inline PieceSymbol inferPieceType(std::string san) {
-        char pieceType = san.at(0);
-        if (pieceType >= 'a' && pieceType <= 'h') {
-            std::regex pattern("[a-h]\\d.*[a-h]\\d");
-            if (std::regex_search(san, pattern)) {
-                return PieceSymbol::NONE;
+    /// A move as written in SAN, LAN or UCI, before it is matched against the legal moves.
+    /// Squares and parts that were not written are -1 or NONE.
+    struct MoveText {
+        PieceSymbol piece = PieceSymbol::NONE;
+        int fromFile = -1;
+        int fromRow = -1;
+        int to = -1;
+        PieceSymbol promotion = PieceSymbol::NONE;
+        bool capture = false;
+        uint16_t castle = 0;
+    };
+
+    /// Tokenizes a move in one pass without allocating. Strict mode accepts only SAN as it is
+    /// generated (piece letters in upper case, no '-', optional '=' and trailing annotations);
+    /// otherwise long forms such as "Ng1-f3", "e2e4" and "e7e8q", lower case piece letters and
+    /// "0-0" are accepted too. A leading 'b' is read as a file unless lowerBishop is set.
+    static inline bool parseMove(const std::string& text, MoveText& out, bool strict, bool lowerBishop = false) {
+        out = MoveText();
+        size_t n = text.size();
+        while (n > 0 && (text[n - 1] == '!' || text[n - 1] == '?')) n--;
+        if (n > 0 && (text[n - 1] == '+' || text[n - 1] == '#')) n--;
+        if (n == 0) return false;
+
+        const auto isFile = [](char c) { return c >= 'a' && c <= 'h'; };
+        const auto isRank = [](char c) { return c >= '1' && c <= '8'; };
+        const auto matches = [&](const char* castle) {
+            const size_t len = std::char_traits<char>::length(castle);
+            if (len != n) return false;
+            for (size_t i = 0; i < len; i++) {
+                const char c = text[i];
+                if (castle[i] == 'O' ? !(c == 'O' || (!strict && (c == '0' || c == 'o'))) : c != castle[i]) return false;
             }
-            return PAWN;
+            return true;
+        };
+
+        if (matches("O-O")) { out.castle = PackedMove::KING_CASTLE; return true; }
+        if (matches("O-O-O")) { out.castle = PackedMove::QUEEN_CASTLE; return true; }
+
+        size_t i = 0;
+        const char first = text[0];
+        if (first == 'N' || first == 'B' || first == 'R' || first == 'Q' || first == 'K') {
+            out.piece = charToSymbol(static_cast<char>(std::tolower(first)));
+            i++;
         }
-        pieceType = static_cast<char>(std::tolower(pieceType));
-        if (pieceType == 'o') {
-            return KING;
+        else if (!strict && (first == 'P' || first == 'p' || first == 'n' || first == 'r' || first == 'q' || first == 'k' || (first == 'b' && lowerBishop))) {
+            out.piece = charToSymbol(static_cast<char>(std::tolower(first)));
+            i++;
         }
-        return charToSymbol(pieceType);
-    }
 
-    static inline std::string strippedSan(std::string move) {
-        return std::regex_replace(std::regex_replace(move, std::regex("="), ""), std::regex("[+#]?[?!]*$"), "");
+        int file = -1;
+        int row = -1;
+        if (i < n && isFile(text[i])) file = text[i++] - 'a';
+        if (i < n && isRank(text[i])) row = '8' - text[i++];
+        if (i < n && text[i] == 'x') { out.capture = true; i++; }
+        if (!strict && i < n && text[i] == '-') i++;
+
+        if (i + 1 < n && isFile(text[i]) && isRank(text[i + 1])) {
+            out.fromFile = file;
+            out.fromRow = row;
+            out.to = ('8' - text[i + 1]) * 8 + (text[i] - 'a');
+            i += 2;
+        }
+        else if (file >= 0 && row >= 0 && !out.capture) {
+            // Only one square was written, so it is the target.
+            out.to = row * 8 + file;
+        }
+        else {
+            return false;
+        }
+
+        const bool equals = i < n && text[i] == '=';
+        if (equals) i++;
+        if (i < n) {
+            const char c = text[i];
+            const char lower = static_cast<char>(std::tolower(c));
+            if ((strict && c == lower) || !(lower == 'n' || lower == 'b' || lower == 'r' || lower == 'q')) return false;
+            out.promotion = charToSymbol(lower);
+            i++;
+        }
+        else if (equals) {
+            return false;
+        }
+        return i == n;
     }
-    
 
     static inline std::string trimFen(std::string fen) {
         std::vector<std::string> stpld = split(fen, ' ');
@@ -4,8 +4,26 @@ using namespace ChessCpp;
 
 /* Class definitions start here */
 
-Chess::Chess(std::string fen) : chImpl(new chrImpl(*this)) { load(fen); }
+Chess::Chess(std::string fen, bool skipValidation) : chImpl(new chrImpl(*this)) {
+	// A rejected FEN leaves the constructor by throwing, so the destructor never frees the implementation.
+	try {
+		load(fen, skipValidation);
+	}
+	catch (...) {
+		delete chImpl;
+		throw;
+	}
+}
 Chess::Chess() : chImpl(new chrImpl(*this)) { load(DEFAULT_POSITION); }
+Chess::Chess(const Chess& other) : chImpl(new chrImpl(*this, *other.chImpl)) {}
+Chess& Chess::operator=(const Chess& other) {
+	if (this != &other) {
+		chrImpl* copy = new chrImpl(*this, *other.chImpl);
+		delete chImpl;
+		chImpl = copy;
+	}
+	return *this;
+}
 Chess::~Chess() { delete chImpl; }
 
 
@@ -22,56 +40,90 @@ void Chess::chrImpl::_updateSetup(std::string fen) {
 	}
 }
 
+namespace {
+	// Castling rights that survive a move touching each square (a king or rook leaving, or a rook being captured).
+	const std::array<uint16_t, 64> CASTLING_RIGHTS_MASK = [] {
+		std::array<uint16_t, 64> mask;
+		mask.fill(CASTLE_WK | CASTLE_WQ | CASTLE_BK | CASTLE_BQ);
+		mask[static_cast<int>(Square::a8)] &= ~CASTLE_BQ;
+		mask[static_cast<int>(Square::e8)] &= ~(CASTLE_BK | CASTLE_BQ);
+		mask[static_cast<int>(Square::h8)] &= ~CASTLE_BK;
+		mask[static_cast<int>(Square::a1)] &= ~CASTLE_WQ;
+		mask[static_cast<int>(Square::e1)] &= ~(CASTLE_WK | CASTLE_WQ);
+		mask[static_cast<int>(Square::h1)] &= ~CASTLE_WK;
+		return mask;
+	}();
+
+	void classifyMoveFlags(PackedMove move, PerftStats& stats) {
+		if (move.isCapture()) ++stats.captures;
+		if (move.isEnPassant()) ++stats.enPassants;
+		if (move.isPromotion()) ++stats.promotions;
+		if (move.isCastle()) ++stats.castles;
+	}
+}
+
 bool Chess::chrImpl::_put(PieceSymbol type, Color color, Square sq) {
 	auto iter = std::find(SYMBOLS.begin(), SYMBOLS.end(), std::tolower(Helper::pieceToChar(type)));
-	if (iter == SYMBOLS.end()) {
+	if (iter == SYMBOLS.end() || color == Color::NONE) {
 		return false;
 	}
 	if (!Helper::isValid8x8(sq)) {
 		return false;
 	}
-	const int squ = Ox88.at((int)(sq));
+	const int squ = static_cast<int>(sq);
+	const Bitboard king = _piecesOf(color, KING);
 
-	if (type == KING && !(_kings[color] == EMPTY || _kings[color] == squ)) {
+	if (type == KING && king && !(king & Bitboards::square(squ))) {
 		return false;
 	}
 
-	const Piece currentPieceOnSquare = _board[squ];
-
-	if (currentPieceOnSquare && currentPieceOnSquare.type == KING) {
-		_kings[currentPieceOnSquare.color] = EMPTY;
+	if (_board[squ]) {
+		_removePiece(squ);
 	}
+	_setPiece(squ, { color, type });
+	return true;
+}
 
-	_board[squ] = { color, type };
+void Chess::chrImpl::_clearBoard() {
+	_board = std::array<Piece, 64>();
+	_pieces = {};
+	_colors = {};
+	_pieceKey = 0;
+	_middlegame = 0;
+	_endgame = 0;
+	_phase = 0;
+}
 
-	if (type == KING) {
-		_kings[color] = squ;
+uint64_t Chess::chrImpl::_hash() const {
+	uint64_t key = _pieceKey ^ Zobrist::castling(_castlings);
+	if (_turn == BLACK) {
+		key ^= Zobrist::side();
 	}
-	return true;
+	// The en passant square counts only when the capture is legal, as in the FEN, so a position reached by
+	// a double push hashes the same as the one loaded from its FEN.
+	if (_epCapturable()) {
+		key ^= Zobrist::enPassant(_epSquare);
+	}
+	return key;
 }
 
 void Chess::chrImpl::_updateCastlingRights() {
-	const bool whiteKingInPlace =
-		!_board.empty() &&
-		_board[Ox88.at((int)(Square::e1))].type == KING &&
-		_board[Ox88.at((int)(Square::e1))].color == WHITE;
-	const bool blackKingInPlace =
-		!_board.empty() &&
-		_board[Ox88.at((int)(Square::e8))].type == KING &&
-		_board[Ox88.at((int)(Square::e8))].color == BLACK;
-	auto isPieceRook = [&](Color c, Square sq) -> bool {
-		return _board[Ox88.at((int)(sq))].type == ROOK && _board[Ox88.at((int)(sq))].color == c;
+	auto isPiece = [&](Square sq, Color c, PieceSymbol type) -> bool {
+		return _board[static_cast<int>(sq)].type == type && _board[static_cast<int>(sq)].color == c;
 	};
-	if (!whiteKingInPlace || !isPieceRook(WHITE, Square::a1)) {
+	const bool whiteKingInPlace = isPiece(Square::e1, WHITE, KING);
+	const bool blackKingInPlace = isPiece(Square::e8, BLACK, KING);
+
+	if (!whiteKingInPlace || !isPiece(Square::a1, WHITE, ROOK)) {
 		_castlings &= ~CASTLE_WQ;
 	}
-	if (!whiteKingInPlace || !isPieceRook(WHITE, Square::h1)) {
+	if (!whiteKingInPlace || !isPiece(Square::h1, WHITE, ROOK)) {
 		_castlings &= ~CASTLE_WK;
 	}
-	if (!blackKingInPlace || !isPieceRook(BLACK, Square::a8)) {
+	if (!blackKingInPlace || !isPiece(Square::a8, BLACK, ROOK)) {
 		_castlings &= ~CASTLE_BQ;
 	}
-	if (!blackKingInPlace || !isPieceRook(BLACK, Square::h8)) {
+	if (!blackKingInPlace || !isPiece(Square::h8, BLACK, ROOK)) {
 		_castlings &= ~CASTLE_BK;
 	}
 }
@@ -79,372 +131,472 @@ void Chess::chrImpl::_updateCastlingRights() {
 void Chess::chrImpl::_updateEnPassantSquare() {
 	if (_epSquare == EMPTY) return;
 
-	const Square startsquare = static_cast<Square>(_epSquare + (_turn == WHITE ? -16 : 16));
-	const Square currentsquare = static_cast<Square>(_epSquare + (_turn == WHITE ? -16 : 16));
-
-	const std::array<int, 2> attackers = { static_cast<int>(currentsquare) + 1, static_cast<int>(currentsquare) - 1 };
+	const Color them = Helper::swapColor(_turn);
+	// The pawn that just moved two squares left startSquare and now stands on currentSquare.
+	const int startSquare = _epSquare + (_turn == WHITE ? -8 : 8);
+	const int currentSquare = _epSquare + (_turn == WHITE ? 8 : -8);
 
-	const std::optional<Piece> stsq = _board[static_cast<int>(startsquare)];
-	const std::optional<Piece> epsq = _board[_epSquare];
-	if (stsq.has_value() || epsq.has_value() ||
-		_board[static_cast<int>(currentsquare)].color != Helper::swapColor(_turn) ||
-		_board[static_cast<int>(currentsquare)].type != PAWN) {
+	if (_board[startSquare] || _board[_epSquare] ||
+		_board[currentSquare].color != them ||
+		_board[currentSquare].type != PAWN) {
 		_epSquare = EMPTY;
 		return;
 	}
 
-	auto canCapture = [&](int square) -> bool {
-		return !(square & 0x88) &&
-			_board[square].color == _turn &&
-			_board[square].type == PAWN;
-		};
-	if (std::any_of(attackers.begin(), attackers.end(), canCapture)) {
+	if (!(Bitboards::pawnAttacks(them, _epSquare) & _piecesOf(_turn, PAWN))) {
 		_epSquare = EMPTY;
 	}
 }
 
-std::vector<PieceSymbol> Chess::chrImpl::_getAttackingPiece(Color c, int sq) {
-	std::vector<PieceSymbol> pieces;
-	for (int i = 0; i <= 119; i++) {
-		if (i & 0x88) {
-			i += 7;
-			continue;
+Bitboard Chess::chrImpl::_attackersTo(int sq, Bitboard occupied) const {
+	const Bitboard bishopsQueens = _pieces[static_cast<int>(BISHOP)] | _pieces[static_cast<int>(QUEEN)];
+	const Bitboard rooksQueens = _pieces[static_cast<int>(ROOK)] | _pieces[static_cast<int>(QUEEN)];
+
+	return (Bitboards::pawnAttacks(BLACK, sq) & _piecesOf(WHITE, PAWN)) |
+		(Bitboards::pawnAttacks(WHITE, sq) & _piecesOf(BLACK, PAWN)) |
+		(Bitboards::knightAttacks(sq) & _pieces[static_cast<int>(KNIGHT)]) |
+		(Bitboards::kingAttacks(sq) & _pieces[static_cast<int>(KING)]) |
+		(Bitboards::bishopAttacks(sq, occupied) & bishopsQueens) |
+		(Bitboards::rookAttacks(sq, occupied) & rooksQueens);
+}
+
+bool Chess::chrImpl::_epCapturable() const {
+	if (_epSquare == EMPTY) return false;
+
+	const Color them = Helper::swapColor(_turn);
+	const int captured = _epSquare + (_turn == WHITE ? 8 : -8);
+	const int king = _kingSquare(_turn);
+	Bitboard capturers = Bitboards::pawnAttacks(them, _epSquare) & _piecesOf(_turn, PAWN);
+	while (capturers) {
+		const int from = Bitboards::popLsb(capturers);
+		if (king == EMPTY) return true;
+
+		// Both pawns leave their squares at once, which can open a line to the king.
+		const Bitboard gone = Bitboards::square(from) | Bitboards::square(captured);
+		const Bitboard occupied = (_occupied() & ~gone) | Bitboards::square(_epSquare);
+		if (!(_attackersTo(king, occupied) & _colors[static_cast<int>(them)] & ~gone)) {
+			return true;
 		}
-		const auto& currentSq = _board[i];
-		if (!currentSq || currentSq.color != c)
-			continue;
-		const Piece& p = currentSq;
-		const int& diff = i - sq;
+	}
+	return false;
+}
 
-		if (diff == 0) continue;
+size_t Chess::chrImpl::_writeFen(char* out) const {
+	static const char PIECE_CHARS[2][6] = { { 'P', 'N', 'B', 'R', 'Q', 'K' }, { 'p', 'n', 'b', 'r', 'q', 'k' } };
+	const auto writeNumber = [](char* p, int value) {
+		char digits[12];
+		int n = 0;
+		unsigned v = value < 0 ? 0U - static_cast<unsigned>(value) : static_cast<unsigned>(value);
+		do {
+			digits[n++] = static_cast<char>('0' + v % 10);
+			v /= 10;
+		} while (v);
+		if (value < 0) *p++ = '-';
+		while (n) *p++ = digits[--n];
+		return p;
+	};
 
-		const int index = diff + 119;
-		if (ATTACKS[index] & getPieceMask(p.type)) {
-			if (p.type == PAWN) {
-				if (diff > 0) {
-					if (p.color == WHITE) pieces.push_back(p.type);
-				}
-				else {
-					if (p.color == BLACK) pieces.push_back(p.type);
-				}
+	char* p = out;
+	for (int row = 0; row < 8; row++) {
+		int empty = 0;
+		for (int sq = row * 8; sq < row * 8 + 8; sq++) {
+			const Piece& piece = _board[sq];
+			if (!piece) {
+				empty++;
 				continue;
 			}
+			if (empty) {
+				*p++ = static_cast<char>('0' + empty);
+				empty = 0;
+			}
+			*p++ = PIECE_CHARS[static_cast<int>(piece.color)][static_cast<int>(piece.type)];
+		}
+		if (empty) *p++ = static_cast<char>('0' + empty);
+		if (row < 7) *p++ = '/';
+	}
 
-			if (p.type == KNIGHT || p.type == KING) pieces.push_back(p.type);
+	*p++ = ' ';
+	*p++ = _turn == WHITE ? 'w' : 'b';
+	*p++ = ' ';
+	if (_castlings & CASTLE_WK) *p++ = 'K';
+	if (_castlings & CASTLE_WQ) *p++ = 'Q';
+	if (_castlings & CASTLE_BK) *p++ = 'k';
+	if (_castlings & CASTLE_BQ) *p++ = 'q';
+	if (!(_castlings & (CASTLE_WK | CASTLE_WQ | CASTLE_BK | CASTLE_BQ))) *p++ = '-';
 
-			const int& offset = RAYS[index];
-			int j = i + offset;
+	*p++ = ' ';
+	if (_epCapturable()) {
+		*p++ = static_cast<char>('a' + (_epSquare & 7));
+		*p++ = static_cast<char>('8' - (_epSquare >> 3));
+	}
+	else {
+		*p++ = '-';
+	}
+	*p++ = ' ';
+	p = writeNumber(p, _halfMoves);
+	*p++ = ' ';
+	p = writeNumber(p, _moveNumber);
+	*p = '\0';
+	return static_cast<size_t>(p - out);
+}
 
-			bool blocked = false;
-			while (j != sq) {
-				const auto& pos = _board[j];
-				if (pos) {
-					blocked = true;
-					break;
-				}
-				j += offset;
-			}
-			if (!blocked) pieces.push_back(p.type);
-		}
+std::vector<PieceSymbol> Chess::chrImpl::_getAttackingPiece(Color c, int sq) {
+	std::vector<PieceSymbol> pieces;
+	if (sq < 0 || sq >= 64 || c == Color::NONE) return pieces;
+
+	Bitboard attackers = _attackersTo(sq, _occupied()) & _colors[static_cast<int>(c)];
+	while (attackers) {
+		pieces.push_back(_board[Bitboards::popLsb(attackers)].type);
 	}
 	return pieces;
 }
 
 bool Chess::chrImpl::_attacked(Color c, int sq) {
-	if ((sq & 0x88) || c == Color::NONE) return false;
-	for (int i = 0; i <= 119; i++) {
-		if (i & 0x88) {
-			i += 7;
-			continue;
-		}
-		const auto& currentSq = _board[i];
-		if (!currentSq || currentSq.color != c)
-			continue;
-		const Piece& p = currentSq;
-		const int& diff = i - sq;
-
-		if (diff == 0) continue;
+	if (sq < 0 || sq >= 64 || c == Color::NONE) return false;
+
+	// Cheapest lookups first; every test is a single table access.
+	const Bitboard attackers = _colors[static_cast<int>(c)];
+	if (Bitboards::pawnAttacks(Helper::swapColor(c), sq) & attackers & _pieces[static_cast<int>(PAWN)]) return true;
+	if (Bitboards::knightAttacks(sq) & attackers & _pieces[static_cast<int>(KNIGHT)]) return true;
+	if (Bitboards::kingAttacks(sq) & attackers & _pieces[static_cast<int>(KING)]) return true;
+
+	const Bitboard occupied = _occupied();
+	const Bitboard queens = _pieces[static_cast<int>(QUEEN)];
+	if (Bitboards::bishopAttacks(sq, occupied) & attackers & (_pieces[static_cast<int>(BISHOP)] | queens)) return true;
+	return (Bitboards::rookAttacks(sq, occupied) & attackers & (_pieces[static_cast<int>(ROOK)] | queens)) != 0;
+}
 
-		const int& index = diff + 119;
-		if (ATTACKS[index] & getPieceMask(p.type)) {
-			if (p.type == PAWN) {
-				if (c == WHITE && (diff == 15 || diff == 17)) return true;
-				if (c == BLACK && (diff == -15 || diff == -17)) return true;
-				continue;
-			}
+bool Chess::chrImpl::_isKingAttacked(Color c) {
+	const int sq = _kingSquare(c);
+	return sq == EMPTY ? false : _attacked(Helper::swapColor(c), sq);
+}
 
-			if (p.type == KNIGHT || p.type == KING) return true;
+MoveList Chess::chrImpl::_moves(const bool& legal, const PieceSymbol& p, const std::string& sq) {
+	MoveList moves;
 
-			const int& offset = RAYS[index];
-			int j = i + offset;
+	const Square& forSquare = !sq.empty() ? stringToSquare(sq) : Square::NONE;
+	Bitboard fromMask = ~0ULL;
 
-			bool blocked = false;
-			while (j != sq) {
-				const auto& pos = _board[j];
-				if (pos) {
-					blocked = true;
-					break;
-				}
-				j += offset;
-			}
-			if (!blocked) return true;
+	if (forSquare != Square::NONE) {
+		if (!Helper::isValid8x8(forSquare)) {
+			return moves;
 		}
+		fromMask = Bitboards::square(static_cast<int>(forSquare));
 	}
-	return false;
+
+	// Without a king there is nothing to leave in check, so every pseudo-legal move is legal.
+	if (legal && _kingSquare(_turn) != EMPTY) {
+		_legalMoves(moves, p, fromMask);
+	}
+	else {
+		_pseudoLegalMoves(moves, p, fromMask);
+	}
+	return moves;
 }
 
-bool Chess::chrImpl::_isKingAttacked(Color c) {
-	const int sq = _kings[c];
-	return sq == -1 ? false : _attacked(Helper::swapColor(c), sq);
+void Chess::chrImpl::_movesFrom(MoveList& moves, int sq) {
+	if (_kingSquare(_turn) != EMPTY) {
+		_legalMoves(moves, PieceSymbol::NONE, Bitboards::square(sq));
+	}
+	else {
+		_pseudoLegalMoves(moves, PieceSymbol::NONE, Bitboards::square(sq));
+	}
 }
 
-std::vector<InternalMove> Chess::chrImpl::_moves(const bool& legal, const PieceSymbol& p, const std::string& sq) {
-	std::vector<InternalMove> moves;
-	moves.reserve(128);
+void Chess::chrImpl::_pseudoLegalMoves(MoveList& moves, PieceSymbol forPiece, Bitboard fromMask) {
 	const Color us = _turn;
 	const Color them = us == WHITE ? BLACK : WHITE;
 
-	const Square& forSquare = !sq.empty() ? stringToSquare(sq) : Square::NONE;
-	const PieceSymbol& forPiece = p;
+	const Bitboard occupied = _occupied();
+	const Bitboard enemies = _colors[static_cast<int>(them)];
+	const int pawnStep = us == WHITE ? -8 : 8;
 
-	int firstSquare = 0;
-	int lastSquare = 119;
-	bool singleSquare = false;
+	Bitboard pieces = _colors[static_cast<int>(us)] & fromMask;
+	if (forPiece != PieceSymbol::NONE) {
+		pieces &= _pieces[static_cast<int>(forPiece)];
+	}
 
-	PieceSymbol pieceType;
+	while (pieces) {
+		const int from = Bitboards::popLsb(pieces);
+		const PieceSymbol pieceType = _board[from].type;
 
-	if (forSquare != Square::NONE) {
-		if (!Helper::isValid8x8(forSquare)) {
-			return {};
+		if (pieceType == PAWN) {
+			int to = from + pawnStep;
+			if (!_board[to]) {
+				Helper::addMove(moves, from, to, PAWN);
+
+				to += pawnStep;
+				if ((us == WHITE ? RANK_2 : RANK_7) == (from >> 3) && !_board[to]) {
+					Helper::addMove(moves, from, to, PAWN, PackedMove::DOUBLE_PUSH);
+				}
+			}
+
+			const Bitboard pawnAttacks = Bitboards::pawnAttacks(us, from);
+			Bitboard captures = pawnAttacks & enemies;
+			while (captures) {
+				to = Bitboards::popLsb(captures);
+				Helper::addMove(moves, from, to, PAWN, PackedMove::CAPTURE);
+			}
+			if (_epSquare != EMPTY && (pawnAttacks & Bitboards::square(_epSquare))) {
+				Helper::addMove(moves, from, _epSquare, PAWN, PackedMove::EN_PASSANT);
+			}
 		}
 		else {
-			firstSquare = Ox88.at((int)(forSquare));
-			lastSquare = firstSquare;
-			singleSquare = true;
+			Bitboard targets = Bitboards::attacks(pieceType, from, occupied) & ~_colors[static_cast<int>(us)];
+			while (targets) {
+				const int to = Bitboards::popLsb(targets);
+				if (_board[to]) {
+					Helper::addMove(moves, from, to, pieceType, PackedMove::CAPTURE);
+				}
+				else {
+					Helper::addMove(moves, from, to, pieceType);
+				}
+			}
 		}
 	}
 
-	for (int from = firstSquare; from <= lastSquare; from++) {
-		if (from & 0x88) {
-			from += 7;
-			continue;
+	const int kingSquare = _kingSquare(us);
+
+	if ((forPiece == PieceSymbol::NONE || forPiece == KING) &&
+		kingSquare != EMPTY && (fromMask & Bitboards::square(kingSquare))) {
+		if (_castlings & CASTLE_KSIDE(us)) {
+			const int castlingFrom = kingSquare;
+			const int castlingTo = castlingFrom + 2;
+			const bool canCastleKSide =
+				!_board[castlingFrom + 1] &&
+				!_board[castlingTo] &&
+				!_attacked(them, kingSquare) &&
+				!_attacked(them, castlingFrom + 1) &&
+				!_attacked(them, castlingTo);
+			if (canCastleKSide) {
+				Helper::addMove(moves, kingSquare, castlingTo, KING, PackedMove::KING_CASTLE);
+			}
 		}
 
-		if (!_board[from] || _board[from].color == them) continue;
+		if (_castlings & CASTLE_QSIDE(us)) {
+			const int castlingFrom = kingSquare;
+			const int castlingTo = castlingFrom - 2;
+			const bool canCastleQSide =
+				!_board[castlingFrom - 1] &&
+				!_board[castlingFrom - 2] &&
+				!_board[castlingFrom - 3] &&
+				!_attacked(them, kingSquare) &&
+				!_attacked(them, castlingFrom - 1) &&
+				!_attacked(them, castlingTo);
+			if (canCastleQSide) {
+				Helper::addMove(moves, kingSquare, castlingTo, KING, PackedMove::QUEEN_CASTLE);
+			}
+		}
+	}
+}
 
-		pieceType = _board[from].type;
+Bitboard Chess::chrImpl::_pinnedPieces(Color c, int kingSquare) const {
+	const Color them = Helper::swapColor(c);
+	const Bitboard occupied = _occupied();
+	const Bitboard queens = _piecesOf(them, QUEEN);
 
-		int to;
+	// Enemy sliders that would hit the king on an empty board; one piece of ours in between is pinned.
+	Bitboard snipers =
+		(Bitboards::rookAttacks(kingSquare, 0) & (_piecesOf(them, ROOK) | queens)) |
+		(Bitboards::bishopAttacks(kingSquare, 0) & (_piecesOf(them, BISHOP) | queens));
 
-		if (pieceType == PAWN) {
-			if (forPiece != PieceSymbol::NONE && forPiece != pieceType) continue;
+	Bitboard pinned = 0;
+	while (snipers) {
+		const Bitboard blockers = Bitboards::between(kingSquare, Bitboards::popLsb(snipers)) & occupied;
+		if (blockers && !Bitboards::moreThanOne(blockers)) {
+			pinned |= blockers & _colors[static_cast<int>(c)];
+		}
+	}
+	return pinned;
+}
 
-			to = from + PAWN_OFFSETS.at(us)[0];
-			if (!_board[to]) {
-				Helper::addMove(moves, us, from, to, PAWN);
+void Chess::chrImpl::_legalMoves(MoveList& moves, PieceSymbol forPiece, Bitboard fromMask) {
+	const Color us = _turn;
+	const Color them = us == WHITE ? BLACK : WHITE;
 
-				to = from + PAWN_OFFSETS.at(us)[1];
-				if ((us == WHITE ? RANK_2 : RANK_7) == rank(from) && !_board[to]) {
-					Helper::addMove(moves, us, from, to, PAWN, PieceSymbol::NONE, BITS_BIG_PAWN);
-				}
-			}
+	const int kingSquare = _kingSquare(us);
+	const Bitboard occupied = _occupied();
+	const Bitboard friends = _colors[static_cast<int>(us)];
+	const Bitboard enemies = _colors[static_cast<int>(them)];
+	const int pawnStep = us == WHITE ? -8 : 8;
+
+	const Bitboard checkers = _attackersTo(kingSquare, occupied) & enemies;
+	const Bitboard pinned = _pinnedPieces(us, kingSquare);
+
+	// Squares a non-king move may land on: anywhere when not in check, otherwise capture the
+	// checker or block its ray. In double check only the king can move.
+	Bitboard evasionMask = ~friends;
+	if (checkers) {
+		evasionMask = Bitboards::moreThanOne(checkers)
+			? 0
+			: checkers | Bitboards::between(kingSquare, Bitboards::lsb(checkers));
+	}
+
+	Bitboard pieces = friends & fromMask;
+	if (forPiece != PieceSymbol::NONE) {
+		pieces &= _pieces[static_cast<int>(forPiece)];
+	}
+
+	while (pieces) {
+		const int from = Bitboards::popLsb(pieces);
+		const PieceSymbol pieceType = _board[from].type;
 
-			for (int j = 2; j < 4; j++) {
-				to = from + PAWN_OFFSETS.at(us)[j];
-				if (to & 0x88) continue;
-
-				if (_board[to] && _board[to].color == them) {
-					Helper::addMove(
-						moves,
-						us,
-						from,
-						to,
-						PAWN,
-						_board[to].type,
-						BITS_CAPTURE
-					);
+		if (pieceType == KING) {
+			// The king itself is lifted from the board so it cannot hide behind its own square on a slider's ray.
+			Bitboard targets = Bitboards::kingAttacks(from) & ~friends;
+			while (targets) {
+				const int to = Bitboards::popLsb(targets);
+				if (_attackersTo(to, occupied ^ Bitboards::square(from)) & enemies) continue;
+
+				if (_board[to]) {
+					Helper::addMove(moves, from, to, KING, PackedMove::CAPTURE);
 				}
-				else if (to == _epSquare) {
-					Helper::addMove(moves, us, from, to, PAWN, PAWN, BITS_EP_CAPTURE);
+				else {
+					Helper::addMove(moves, from, to, KING);
 				}
 			}
+			continue;
 		}
-		else {
-			if (forPiece != PieceSymbol::NONE && forPiece != pieceType) continue;
-
-			for (int j = 0, len = static_cast<int>(PIECE_OFFSETS.at(pieceType).size()); j < len; j++) {
-				const int offset = PIECE_OFFSETS.at(pieceType)[j];
-				to = from;
-
-				while (true) {
-					to += offset;
-					if (to & 0x88) break;
-
-					if (!_board[to]) {
-						Helper::addMove(moves, us, from, to, pieceType);
-					}
-					else {
-						if (_board[to].color == us) break;
-
-						Helper::addMove(
-							moves,
-							us,
-							from,
-							to,
-							pieceType,
-							_board[to].type,
-							BITS_CAPTURE
-						);
-						break;
-					}
-
-					if (pieceType == KNIGHT || pieceType == KING) break;
-				}
-			}
+
+		Bitboard allowed = evasionMask;
+		if (pinned & Bitboards::square(from)) {
+			allowed &= Bitboards::line(kingSquare, from);
 		}
-	}
+		if (!allowed) continue;
 
-	if (forPiece == PieceSymbol::NONE || forPiece == KING) {
-		if (!singleSquare || lastSquare == _kings[us]) {
-			if (_castlings & CASTLE_KSIDE(us)) {
-				const int castlingFrom = _kings[us];
-				const int castlingTo = castlingFrom + 2;
-				const bool canCastleKSide =
-					!_board[castlingFrom + 1] &&
-					!_board[castlingTo] &&
-					!_attacked(them, _kings[(us)]) &&
-					!_attacked(them, castlingFrom + 1) &&
-					!_attacked(them, castlingTo);
-				if (canCastleKSide) {
-					Helper::addMove(
-						moves,
-						us,
-						_kings[us],
-						castlingTo,
-						KING,
-						PieceSymbol::NONE,
-						BITS_KSIDE_CASTLE
-					);
+		if (pieceType == PAWN) {
+			int to = from + pawnStep;
+			if (!_board[to]) {
+				if (allowed & Bitboards::square(to)) {
+					Helper::addMove(moves, from, to, PAWN);
+				}
+
+				to += pawnStep;
+				if ((us == WHITE ? RANK_2 : RANK_7) == (from >> 3) && !_board[to] && (allowed & Bitboards::square(to))) {
+					Helper::addMove(moves, from, to, PAWN, PackedMove::DOUBLE_PUSH);
 				}
 			}
 
-			if (_castlings & CASTLE_QSIDE(us)) {
-				const int castlingFrom = _kings[us];
-				const int castlingTo = castlingFrom - 2;
-				const bool canCastleQSide =
-					!_board[castlingFrom - 1] &&
-					!_board[castlingFrom - 2] &&
-					!_board[castlingFrom - 3] &&
-					!_attacked(them, _kings[us]) &&
-					!_attacked(them, castlingFrom - 1) &&
-					!_attacked(them, castlingTo);
-				if (canCastleQSide) {
-					Helper::addMove(
-						moves,
-						us,
-						_kings[us],
-						castlingTo,
-						KING,
-						PieceSymbol::NONE,
-						BITS_QSIDE_CASTLE
-					);
+			const Bitboard pawnAttacks = Bitboards::pawnAttacks(us, from);
+			Bitboard captures = pawnAttacks & enemies & allowed;
+			while (captures) {
+				to = Bitboards::popLsb(captures);
+				Helper::addMove(moves, from, to, PAWN, PackedMove::CAPTURE);
+			}
+
+			if (_epSquare != EMPTY && (pawnAttacks & Bitboards::square(_epSquare))) {
+				// En passant removes two pieces from one rank, which can expose the king in ways the
+				// pin mask does not describe, so test the resulting position directly.
+				const int capturedSquare = _epSquare - pawnStep;
+				const Bitboard after = (occupied ^ Bitboards::square(from) ^ Bitboards::square(capturedSquare)) | Bitboards::square(_epSquare);
+				if (!(_attackersTo(kingSquare, after) & enemies & ~Bitboards::square(capturedSquare))) {
+					Helper::addMove(moves, from, _epSquare, PAWN, PackedMove::EN_PASSANT);
+				}
+			}
+		}
+		else {
+			Bitboard targets = Bitboards::attacks(pieceType, from, occupied) & allowed;
+			while (targets) {
+				const int to = Bitboards::popLsb(targets);
+				if (_board[to]) {
+					Helper::addMove(moves, from, to, pieceType, PackedMove::CAPTURE);
+				}
+				else {
+					Helper::addMove(moves, from, to, pieceType);
 				}
 			}
 		}
 	}
 
-	 // return all pseudo-legal moves (this includes moves that allow the king
-	 // to be captured)
-	 
-	if (!legal || _kings[us] == EMPTY) {
-		return moves;
+	const int homeSquare = static_cast<int>(us == WHITE ? Square::e1 : Square::e8);
+	if (checkers || kingSquare != homeSquare ||
+		(forPiece != PieceSymbol::NONE && forPiece != KING) || !(fromMask & Bitboards::square(kingSquare))) {
+		return;
 	}
 
-	std::vector<InternalMove> legalMoves = {};
-	legalMoves.reserve(64);
-
-	for (int i = 0; i < static_cast<int>(moves.size()); i++) {
-		_makeMove(moves[i]);
-		if (!_isKingAttacked(us)) {
-			legalMoves.push_back(moves[i]);
+	// Castling: the squares between king and rook must be empty, and the king may not pass through
+	// or land on an attacked square.
+	if (_castlings & CASTLE_KSIDE(us)) {
+		const int castlingTo = kingSquare + 2;
+		const bool canCastleKSide =
+			!(occupied & Bitboards::between(kingSquare, kingSquare + 3)) &&
+			!(_attackersTo(kingSquare + 1, occupied) & enemies) &&
+			!(_attackersTo(castlingTo, occupied) & enemies);
+		if (canCastleKSide) {
+			Helper::addMove(moves, kingSquare, castlingTo, KING, PackedMove::KING_CASTLE);
 		}
-		_undoMove();
 	}
 
-	return legalMoves;
+	if (_castlings & CASTLE_QSIDE(us)) {
+		const int castlingTo = kingSquare - 2;
+		const bool canCastleQSide =
+			!(occupied & Bitboards::between(kingSquare, kingSquare - 4)) &&
+			!(_attackersTo(kingSquare - 1, occupied) & enemies) &&
+			!(_attackersTo(castlingTo, occupied) & enemies);
+		if (canCastleQSide) {
+			Helper::addMove(moves, kingSquare, castlingTo, KING, PackedMove::QUEEN_CASTLE);
+		}
+	}
 }
 
-void Chess::chrImpl::_push(const InternalMove& move) {
+void Chess::chrImpl::_push(PackedMove move, PieceSymbol piece, PieceSymbol captured) {
 	_history.push_back({
 		move,
-		_kings,
+		piece,
+		captured,
 		_turn,
 		_castlings,
 		_epSquare,
 		_halfMoves,
-		_moveNumber
+		_moveNumber,
+		_hash()
 	});
 }
 
-void Chess::chrImpl::_makeMove(const InternalMove& m) {
+InternalMove Chess::chrImpl::_unpack(PackedMove m) const {
+	const Piece& moving = _board[m.from()];
+	const PieceSymbol captured = m.isEnPassant() ? PAWN : _board[m.to()].type;
+	return InternalMove(moving.color, m.from(), m.to(), moving.type, captured, m.promotion(), m.flags());
+}
+
+void Chess::chrImpl::_makeMove(PackedMove m) {
 	const Color us = _turn;
 	const Color them = Helper::swapColor(us);
-	_push(m);
+	const int from = m.from();
+	const int to = m.to();
+	const PieceSymbol piece = _board[from].type;
 
-	_board[m.to] = _board[m.from];
-	_board[m.from] = Piece();
+	const int capturedSquare = m.isEnPassant() ? (us == WHITE ? to + 8 : to - 8) : to;
+	const PieceSymbol captured = _board[capturedSquare].type;
+	_push(m, piece, captured);
 
-	if (m.flags & BITS_EP_CAPTURE) {
-		if (_turn == BLACK) {
-			_board[m.to - 16] = Piece();
-		}
-		else {
-			_board[m.to + 16] = Piece();
-		}
+	if (captured != PieceSymbol::NONE) {
+		_removePiece(capturedSquare);
 	}
-	if (m.promotion != PieceSymbol::NONE) {
-		_board[m.to] = Piece(us, m.promotion);
-	}
-	if (_board[m.to].type == KING) {
-		_kings[us] = m.to;
 
-		if (m.flags & BITS_KSIDE_CASTLE) {
-			const int castlingTo = m.to - 1;
-			const int castlingFrom = m.to + 1;
-			_board[castlingTo] = _board[castlingFrom];
-			_board[castlingFrom] = Piece();
-		}
-		else if (m.flags & BITS_QSIDE_CASTLE) {
-			const int castlingTo = m.to + 1;
-			const int castlingFrom = m.to - 2;
-			_board[castlingTo] = _board[castlingFrom];
-			_board[castlingFrom] = Piece();
-		}
-		_castlings &= ~(CASTLE_KSIDE(us) | CASTLE_QSIDE(us));
+	_movePiece(from, to);
+
+	if (m.isPromotion()) {
+		_removePiece(to);
+		_setPiece(to, Piece(us, m.promotion()));
 	}
 
-	switch (m.from) {
-	case 0:  _castlings &= ~CASTLE_WQ; break;
-	case 7:  _castlings &= ~CASTLE_WK; break;
-	case 56: _castlings &= ~CASTLE_BQ; break;
-	case 63: _castlings &= ~CASTLE_BK; break;
+	if (m.kind() == PackedMove::KING_CASTLE) {
+		_movePiece(to + 1, to - 1);
+	}
+	else if (m.kind() == PackedMove::QUEEN_CASTLE) {
+		_movePiece(to - 2, to + 1);
 	}
 
-	if (m.flags & BITS_BIG_PAWN) {
-		if (us == BLACK) {
-			_epSquare = m.to - 16;
-		}
-		else {
-			_epSquare = m.to + 16;
-		}
+	_castlings &= CASTLING_RIGHTS_MASK[from] & CASTLING_RIGHTS_MASK[to];
+
+	if (m.isDoublePush()) {
+		_epSquare = us == WHITE ? to + 8 : to - 8;
 	}
 	else {
 		_epSquare = EMPTY;
 	}
-	if (m.piece == PAWN) {
-		_halfMoves = 0;
-	}
-	else if (m.flags & (BITS_CAPTURE | BITS_EP_CAPTURE)) {
+	if (piece == PAWN || captured != PieceSymbol::NONE) {
 		_halfMoves = 0;
 	}
 	else {
@@ -457,288 +609,308 @@ void Chess::chrImpl::_makeMove(const InternalMove& m) {
 	_turn = them;
 }
 
-InternalMove Chess::chrImpl::_undoMove() {
-	const std::optional<History>& old = _history.back();
-	_history.pop_back();
-
-	if (!old) return InternalMove();
+PackedMove Chess::chrImpl::_undoMove() {
+	if (_history.empty()) return PackedMove();
 
-	const InternalMove& m = old.value().move;
+	const History& old = _history.back();
+	const PackedMove m = old.move;
+	const int from = m.from();
+	const int to = m.to();
 
-	_kings = old.value().kings;
-	_turn = old.value().turn;
-	_castlings = old.value().castling;
-	_epSquare = old.value().epSquare;
-	_halfMoves = old.value().halfMoves;
-	_moveNumber = old.value().moveNumber;
+	_turn = old.turn;
+	_castlings = old.castling;
+	_epSquare = old.epSquare;
+	_halfMoves = old.halfMoves;
+	_moveNumber = old.moveNumber;
 
 	const Color us = _turn;
 	const Color them = Helper::swapColor(us);
 
-	_board[m.from] = _board[m.to];
-	_board[m.from].type = m.piece;
-	_board[m.to] = Piece();
+	if (m.isPromotion()) {
+		_removePiece(to);
+		_setPiece(to, Piece(us, PAWN));
+	}
+	_movePiece(to, from);
 
-	if (m.captured != PieceSymbol::NONE) {
-		if (m.flags & BITS_EP_CAPTURE) {
-			int index;
-			if (us == BLACK) {
-				index = m.to - 16;
-			}
-			else {
-				index = m.to + 16;
-			}
-			_board[index] = { them, PAWN };
-		}
-		else {
-			_board[m.to] = { them, m.captured };
-		}
+	if (old.captured != PieceSymbol::NONE) {
+		const int capturedSquare = m.isEnPassant() ? (us == WHITE ? to + 8 : to - 8) : to;
+		_setPiece(capturedSquare, { them, old.captured });
 	}
-	if (m.flags & (BITS_KSIDE_CASTLE | BITS_QSIDE_CASTLE)) {
-		int castlingTo, castlingFrom;
-		if (m.flags & BITS_KSIDE_CASTLE) {
-			castlingTo = m.to + 1;
-			castlingFrom = m.to - 1;
-		}
-		else {
-			castlingTo = m.to - 2;
-			castlingFrom = m.to + 1;
-		}
-		_board[castlingTo] = _board[castlingFrom];
-		_board[castlingFrom] = Piece();
+	if (m.kind() == PackedMove::KING_CASTLE) {
+		_movePiece(to - 1, to + 1);
+	}
+	else if (m.kind() == PackedMove::QUEEN_CASTLE) {
+		_movePiece(to + 1, to - 2);
+	}
+	_history.pop_back();
+	if (_historyText.size() > _history.size()) {
+		_historyText.pop_back();
 	}
 	return m;
 }
 
-std::string Chess::chrImpl::_moveToSan(InternalMove m, std::vector<InternalMove> moves) {
+const char* Chess::chrImpl::_checkSuffix(PackedMove m) {
+	const Color them = Helper::swapColor(_turn);
+	_makeMove(m);
+
+	const char* suffix = "";
+	const int king = _kingSquare(them);
+	if (king != EMPTY && (_attackersTo(king, _occupied()) & _colors[static_cast<int>(Helper::swapColor(them))])) {
+		suffix = _moves(true).empty() ? "#" : "+";
+	}
+	_undoMove();
+	return suffix;
+}
+
+std::string Chess::chrImpl::_san(PackedMove m, Bitboard rivals) {
 	std::string output = "";
 
-	if (m.flags & BITS_KSIDE_CASTLE) {
+	if (m.kind() == PackedMove::KING_CASTLE) {
 		output = "O-O";
 	}
-	else if (m.flags & BITS_QSIDE_CASTLE) {
+	else if (m.kind() == PackedMove::QUEEN_CASTLE) {
 		output = "O-O-O";
 	}
 	else {
-		if (m.piece != PAWN) {
-			std::string disambiguator = Helper::getDisambiguator(m, moves);
-			output += std::string(1, std::toupper(Helper::pieceToChar(m.piece))) + disambiguator;
-		}
-		if (m.flags & (BITS_CAPTURE | BITS_EP_CAPTURE)) {
-			if (m.piece == PAWN) {
-				output += squareToString(algebraic(m.from))[0];
+		const PieceSymbol piece = _board[m.from()].type;
+		if (piece != PAWN) {
+			output += static_cast<char>(std::toupper(Helper::pieceToChar(piece)));
+			output += Helper::getDisambiguator(m.from(), rivals);
+		}
+		if (m.isCapture()) {
+			if (piece == PAWN) {
+				output += squareToString(static_cast<Square>(m.from()))[0];
 			}
 			output += 'x';
 		}
 
-		output += squareToString(algebraic(m.to));
-
-		if (m.promotion != PieceSymbol::NONE) {
-			output += std::string(1, '=') + std::string(1, std::toupper(Helper::pieceToChar(m.promotion)));
-		}
-	}
-
-	_makeMove(m);
+		output += squareToString(static_cast<Square>(m.to()));
 
-	if (ch.isCheck()) {
-		if (ch.isCheckmate()) {
-			output += '#';
-		}
-		else {
-			output += '+';
+		if (m.isPromotion()) {
+			output += '=';
+			output += static_cast<char>(std::toupper(Helper::pieceToChar(m.promotion())));
 		}
 	}
-	_undoMove();
 
+	output += _checkSuffix(m);
 	return output;
 }
 
-std::optional<InternalMove> Chess::chrImpl::_moveFromSan(std::string move, bool strict) {
-	const std::string cleanMove = Helper::strippedSan(move);
-
-	PieceSymbol pieceType = Helper::inferPieceType(cleanMove);
-	std::vector<InternalMove> moves = _moves(true, pieceType);
-
-	for (int i = 0; i < static_cast<int>(moves.size()); i++) {
-		if (cleanMove == Helper::strippedSan(_moveToSan(moves[i], moves))) {
-			return moves[i];
+std::string Chess::chrImpl::_moveToSan(PackedMove m, const MoveList& moves) {
+	const PieceSymbol piece = _board[m.from()].type;
+	Bitboard rivals = 0;
+	for (const auto& other : moves) {
+		if (other.to() == m.to() && other.from() != m.from() && _board[other.from()].type == piece) {
+			rivals |= Bitboards::square(other.from());
 		}
 	}
+	return _san(m, rivals);
+}
 
-	if (strict) {
-		return std::nullopt;
+void Chess::chrImpl::_movesToSan(const MoveList& moves, const MoveList& legal, std::vector<std::string>& out) {
+	// Origins of all legal moves, grouped by piece type and target square, so each move's
+	// disambiguation is a lookup instead of a scan of the whole list.
+	std::array<std::array<Bitboard, 64>, 6> origins = {};
+	for (const auto& m : legal) {
+		origins[static_cast<int>(_board[m.from()].type)][m.to()] |= Bitboards::square(m.from());
 	}
 
-	std::smatch matches;
-	std::optional<std::string> p;
-	Square from = Square::NONE;
-	Square to = Square::NONE;
-	std::optional<std::string> promotion;
-
-	bool overlyDisambiguated = false;
-
-	std::regex case1(R"(([pnbrqkPNBRQK])?([a-h][1-8])x?-?([a-h][1-8])([qrbnQRBN])?)");
-	std::regex case2(R"(([pnbrqkPNBRQK])?([a-h]?[1-8]?)x?-?([a-h][1-8])([qrbnQRBN])?)");
-
-	bool hasMatch = std::regex_match(cleanMove, matches, case1);
-
-	std::string fromSq, toSq;
+	out.reserve(out.size() + moves.size());
+	for (const auto& m : moves) {
+		const Bitboard rivals = origins[static_cast<int>(_board[m.from()].type)][m.to()] & ~Bitboards::square(m.from());
+		out.push_back(_san(m, rivals));
+	}
+}
 
-	if (hasMatch) {
-		p = matches[1];
-		fromSq = matches[2];
-		toSq = matches[3];
-		promotion = matches[4];
+PackedMove Chess::chrImpl::_moveFromSan(const std::string& move, bool strict) {
+	return _moveFromSan(move, _moves(true), strict);
+}
 
-		to = stringToSquare(toSq);
-		from = fromSq.size() == 1 ? stringToSquare(fromSq + toSq[1]) : stringToSquare(fromSq);
+PackedMove Chess::chrImpl::_moveFromSan(const std::string& move, const MoveList& moves, bool strict) {
+	Helper::MoveText text;
+	if (move.empty()) {
+		return PackedMove();
+	}
 
-		if (fromSq.size() == 1) {
-			overlyDisambiguated = true;
-		}
+	PackedMove found;
+	if (Helper::parseMove(move, text, strict)) {
+		found = _matchMove(text, moves, strict);
 	}
-	else {
-		hasMatch = std::regex_match(cleanMove, matches, case2);
-		if (hasMatch) {
-			p = matches[1];
-			fromSq = matches[2];
-			toSq = matches[3];
-			promotion = matches[4];
-
-			to = stringToSquare(toSq);
-
-			if (fromSq.size() == 1) {
-				overlyDisambiguated = true;
-				from = stringToSquare(fromSq + toSq[1]);
-			}
-		}
+	// A lower case 'b' is a pawn on the b-file first, and a bishop only if that finds nothing.
+	if (!found && !strict && move[0] == 'b' && Helper::parseMove(move, text, strict, true)) {
+		found = _matchMove(text, moves, strict);
 	}
+	return found;
+}
 
-	pieceType = Helper::inferPieceType(cleanMove);
-	moves = _moves(true, (p && p.value() != "") ? Helper::charToSymbol(std::tolower(p.value().at(0))) : pieceType);
-	if (to == Square::NONE) {
-		return std::nullopt;
-	}
-	to = stringToSquare(toSq);
-	for (int i = 0, len = static_cast<int>(moves.size()); i < len; i++) {
-		if (from == Square::NONE) {
-			std::string moveStr = Helper::strippedSan(_moveToSan(moves[i], moves));
-			std::string currentMove = Helper::replaceSubstring(moveStr, "x", "");
-			if (cleanMove == currentMove) {
-				return moves[i];
+PackedMove Chess::chrImpl::_matchMove(const Helper::MoveText& text, const MoveList& moves, bool strict) const {
+	if (text.castle) {
+		for (const auto& m : moves) {
+			if (m.kind() == text.castle) {
+				return m;
 			}
 		}
-		else if ((!p || Helper::charToSymbol(std::tolower(p.value()[0])) == moves[i].piece) &&
-			Ox88.at((int)(from)) == moves[i].from && 
-			Ox88.at((int)(to)) == moves[i].to &&
-			(!promotion.has_value() || Helper::charToSymbol(std::tolower(promotion.value()[0])) == moves[i].promotion)) {
-			return moves[i];
+		return PackedMove();
+	}
+
+	// With no piece letter the move is a pawn's, unless a whole origin square was given (LAN/UCI).
+	const bool anyPiece = text.piece == PieceSymbol::NONE && text.fromFile >= 0 && text.fromRow >= 0 && !strict;
+	const PieceSymbol piece = text.piece == PieceSymbol::NONE ? PAWN : text.piece;
+
+	PackedMove found;
+	Bitboard rivals = 0;
+	for (const auto& m : moves) {
+		if (m.to() != text.to) continue;
+		const PieceSymbol type = _board[m.from()].type;
+		if (!anyPiece && type != piece) continue;
+		if (m.isPromotion() && m.promotion() != text.promotion) continue;
+		if (!m.isPromotion() && text.promotion != PieceSymbol::NONE) continue;
+
+		if ((text.fromFile >= 0 && (m.from() & 7) != text.fromFile) ||
+			(text.fromRow >= 0 && (m.from() >> 3) != text.fromRow)) {
+			rivals |= Bitboards::square(m.from());
+			continue;
 		}
-		else if (overlyDisambiguated) {
-			Square sq = algebraic(moves[i].from);
-			if ((!p || Helper::charToSymbol(std::tolower(p.value()[0])) == moves[i].piece) &&
-				Ox88.at((int)(to)) == moves[i].to &&
-				(from == sq) &&
-				Ox88.at((int)(from)) == moves[i].from &&
-				Ox88.at((int)(to)) == moves[i].to &&
-				(!promotion || Helper::charToSymbol(std::tolower(promotion.value()[0])) == moves[i].promotion)) {
-				return moves[i];
-			}
+		if (found) {
+			return PackedMove();
 		}
+		found = m;
 	}
-	return std::nullopt;
-}
-
-int Chess::chrImpl::_getPositionCount(std::string fen) {
-	std::string trimmedFen = Helper::trimFen(fen);
-	return _positionCount.count(trimmedFen) > 0 ? _positionCount.at(trimmedFen).value() : 0;
-}
 
-void Chess::chrImpl::_incPositionCount(std::string fen) {
-	std::string trimmedFen = Helper::trimFen(fen);
-	if (_positionCount.count(trimmedFen) == 0) {
-		_positionCount.insert({ trimmedFen, 0 });
+	if (!found || !strict) {
+		return found;
 	}
-	_positionCount.at(trimmedFen).value() += 1;
-}
 
-void Chess::chrImpl::_decPositionCount(std::string fen) {
-	std::string trimmedFen = Helper::trimFen(fen);
-	if (!_positionCount.at(trimmedFen).has_value()) {
-		_positionCount.at(trimmedFen) = std::nullopt;
+	// Strict SAN must be written exactly as it would be generated: capture mark and minimal disambiguation.
+	if (text.capture != found.isCapture()) {
+		return PackedMove();
 	}
-	else {
-		_positionCount.at(trimmedFen).value() -= 1;
+	int file = -1;
+	int row = -1;
+	if (piece == PAWN) {
+		if (found.isCapture()) file = found.from() & 7;
 	}
+	else if (rivals) {
+		const bool sameRank = (rivals & (RANK_8_BB << (found.from() & 56))) != 0;
+		const bool sameFile = (rivals & (FILE_A_BB << (found.from() & 7))) != 0;
+		if (sameFile) row = found.from() >> 3;
+		if (sameRank || !sameFile) file = found.from() & 7;
+	}
+	return (file == text.fromFile && row == text.fromRow) ? found : PackedMove();
 }
 
-Move Chess::chrImpl::_makePretty(InternalMove uglyMove) {
-	std::string prettyFlags = "";
-	Color c = uglyMove.color;
-	PieceSymbol p = uglyMove.piece;
-	int from = uglyMove.from;
-	int to = uglyMove.to;
-	int flags = uglyMove.flags;
-	PieceSymbol cpd = uglyMove.captured;
-	PieceSymbol promotion = uglyMove.promotion;
-	const std::unordered_map<std::string, int> BITS = {
-		{"NORMAL", 1},
-		{"CAPTURE", 2},
-		{"BIG_PAWN", 4},
-		{"EP_CAPTURE", 8},
-		{"PROMOTION", 16},
-		{"KSIDE_CASTLE", 32},
-		{"QSIDE_CASTLE", 64}
-	};
-	const std::unordered_map<std::string, char> FLAGS = {
-		{"NORMAL", 'n'},
-		{"CAPTURE", 'c'},
-		{"BIG_PAWN", 'b'},
-		{"EP_CAPTURE", 'e'},
-		{"PROMOTION", 'p'},
-		{"KSIDE_CASTLE", 'k'},
-		{"QSIDE_CASTLE", 'q'}
-	};
-	for (auto& val : BITS) {
-		if (val.second & flags) {
-			prettyFlags += FLAGS.at(val.first);
+int Chess::chrImpl::_repetitionCount() const {
+	const uint64_t key = _hash();
+	const int reversible = std::min(_halfMoves, static_cast<int>(_history.size()));
+	int count = 1;
+	// Only positions with the same side to move can repeat, so step back two plies at a time.
+	for (int plies = 2; plies <= reversible; plies += 2) {
+		if (_history[_history.size() - plies].hash == key) {
+			count++;
 		}
 	}
+	return count;
+}
 
-	const Square fromAlgebraic = algebraic(from);
-	const Square toAlgebraic = algebraic(to);
+Move Chess::chrImpl::_makePretty(InternalMove uglyMove) {
+	const PackedMove packed(uglyMove);
 
 	Move m = Move {
-		c,
-		fromAlgebraic,
-		toAlgebraic,
-		p,
-		cpd,
-		promotion,
-		prettyFlags,
-		"",
-		squareToString(fromAlgebraic) + squareToString(toAlgebraic),
-		ch.fen(),
+		uglyMove.color,
+		static_cast<Square>(uglyMove.from),
+		static_cast<Square>(uglyMove.to),
+		uglyMove.piece,
+		uglyMove.captured,
+		uglyMove.promotion,
+		Helper::flagsToString(uglyMove.flags),
+		_moveToSan(packed, _moves(true)),
+		Helper::moveToLan(packed),
+		ch->fen(),
 		""
 	};
 
-	_makeMove(uglyMove);
-	m.after = ch.fen();
+	_makeMove(packed);
+	m.after = ch->fen();
 	_undoMove();
+	return m;
+}
 
-	if (cpd != PieceSymbol::NONE) {
-		m.captured = cpd;
+PackedMove Chess::chrImpl::_findMove(const std::variant<std::string, MoveOption>& moveArg, const MoveList& legal, bool strict) {
+	if (std::holds_alternative<std::string>(moveArg)) {
+		const PackedMove m = _moveFromSan(std::get<std::string>(moveArg), legal, strict);
+		if (!m) {
+			throw std::runtime_error("Invalid move: " + std::get<std::string>(moveArg));
+		}
+		return m;
 	}
-	if (promotion != PieceSymbol::NONE) {
-		// If the move is a promotion, we add the promotion piece to the LAN
-		m.promotion = promotion;
-		m.lan += Helper::pieceToChar(promotion);
+
+	const MoveOption& o = std::get<MoveOption>(moveArg);
+	const Square from = stringToSquare(o.from);
+	const Square to = stringToSquare(o.to);
+	const PieceSymbol promotion = o.promotion ? Helper::charToSymbol(o.promotion.value()[0]) : PieceSymbol::NONE;
+
+	for (const auto& m : legal) {
+		if (from == static_cast<Square>(m.from()) &&
+			to == static_cast<Square>(m.to()) &&
+			(!m.isPromotion() || promotion == m.promotion())) {
+			return m;
+		}
 	}
-	return m;
+	throw std::runtime_error("Invalid move: from " + o.from + "to " + o.to);
+}
+
+void Chess::chrImpl::_playMove(PackedMove m, const MoveList& legal) {
+	char fen[FEN_BUFFER_SIZE];
+	const size_t length = _writeFen(fen);
+	std::string san = _moveToSan(m, legal);
+
+	_makeMove(m);
+	const size_t ply = _history.size() - 1;
+	if (_historyText.size() <= ply) {
+		_historyText.resize(ply + 1);
+	}
+	HistoryText& text = _historyText[ply];
+	text.san = std::move(san);
+	text.fen.assign(fen, length);
+}
+
+void Chess::chrImpl::_cacheHistory() {
+	size_t first = 0;
+	while (first < _history.size() && _textCached(first)) first++;
+	if (first == _history.size()) return;
+
+	// Rewind to the first move without a cache, then replay from there once.
+	std::vector<PackedMove> replay;
+	while (_history.size() > first) {
+		replay.push_back(_undoMove());
+	}
+	while (!replay.empty()) {
+		_playMove(replay.back(), _moves(true));
+		replay.pop_back();
+	}
+}
+
+Move Chess::chrImpl::_historyMove(size_t ply) {
+	const History& h = _history[ply];
+	const HistoryText& text = _historyText[ply];
+	const PackedMove m = h.move;
+	return Move {
+		h.turn,
+		static_cast<Square>(m.from()),
+		static_cast<Square>(m.to()),
+		h.piece,
+		h.captured,
+		m.promotion(),
+		Helper::flagsToString(m.flags()),
+		text.san,
+		Helper::moveToLan(m),
+		text.fen,
+		ply + 1 < _history.size() ? _historyText[ply + 1].fen : ch->fen()
+	};
 }
 
 void Chess::chrImpl::_pruneComments() {
-	std::vector<std::optional<InternalMove>> reservedHistory = {};
+	std::vector<PackedMove> reservedHistory = {};
 	std::map<std::string, std::string> currentComments = {};
 
 	const auto copyComment = [&](std::string fen) -> void {
@@ -751,14 +923,91 @@ void Chess::chrImpl::_pruneComments() {
 		reservedHistory.push_back(_undoMove());
 	}
 
-	copyComment(ch.fen());
+	copyComment(ch->fen());
 
-	while (true) {
-		std::optional<InternalMove> m = reservedHistory[reservedHistory.size() - 1];
-		if (!m) break;
-		_makeMove(m.value());
-		copyComment(ch.fen());
+	while (!reservedHistory.empty()) {
+		_makeMove(reservedHistory.back());
+		reservedHistory.pop_back();
+		copyComment(ch->fen());
 	}
 	_comments = currentComments;
 }
 
+
+uint64_t Chess::chrImpl::_perft(int depth) {
+	if (depth == 0) return 1;
+
+	// Leaf counts are cheaper to regenerate than to look up, so only deeper subtrees are cached.
+	const bool cached = _perftTable && depth > 1;
+	const uint64_t key = cached ? _hash() : 0;
+	uint64_t nodes = 0;
+	if (cached && _perftTable->probe(key, depth, nodes)) {
+		return nodes;
+	}
+
+	const auto moves = _moves(true);
+	if (depth == 1) {
+		return moves.size();
+	}
+
+	for (const auto& m : moves) {
+		_makeMove(m);
+		nodes += _perft(depth - 1);
+		_undoMove();
+	}
+
+	if (cached) {
+		_perftTable->store(key, depth, nodes);
+	}
+	return nodes;
+}
+
+void Chess::chrImpl::_perftStats(int depth, PerftStats& stats) {
+	const auto moves = _moves(true);
+	if (depth > 1) {
+		for (const auto& m : moves) {
+			_makeMove(m);
+			_perftStats(depth - 1, stats);
+			_undoMove();
+		}
+		return;
+	}
+
+	stats.nodes += moves.size();
+	for (const auto& m : moves) {
+		classifyMoveFlags(m, stats);
+
+		// Squares of the pieces that moved; a checker anywhere else was uncovered by the move.
+		Bitboard moved = Bitboards::square(m.to());
+		if (m.kind() == PackedMove::KING_CASTLE) moved |= Bitboards::square(m.to() - 1);
+		if (m.kind() == PackedMove::QUEEN_CASTLE) moved |= Bitboards::square(m.to() + 1);
+
+		const Color us = _turn;
+		_makeMove(m);
+		const int king = _kingSquare(_turn);
+		const Bitboard checkers = king == EMPTY ? 0 :
+			_attackersTo(king, _occupied()) & _colors[static_cast<int>(us)];
+		if (checkers) {
+			++stats.checks;
+			// Double checks are counted on their own, not as discovered checks as well.
+			if (Bitboards::moreThanOne(checkers)) ++stats.doubleChecks;
+			else if (checkers & ~moved) ++stats.discoveredChecks;
+			if (_moves(true).empty()) ++stats.checkmates;
+		}
+		_undoMove();
+	}
+}
+
+void Chess::chrImpl::_splitPoints(int depth, std::vector<PackedMove>& path, std::vector<std::vector<PackedMove>>& out) {
+	if (depth == 0) {
+		out.push_back(path);
+		return;
+	}
+	for (const auto& m : _moves(true)) {
+		path.push_back(m);
+		_makeMove(m);
+		_splitPoints(depth - 1, path, out);
+		_undoMove();
+		path.pop_back();
+	}
+}
@@ -1,28 +1,121 @@
 #pragma once
 #include "Helper.h"
+#include "Bitboard.h"
+#include "Zobrist.h"
+#include "Evaluation.h"
+#include "PerftTable.h"
+#include "Search.h"
 using namespace ChessCpp;
 class Chess::chrImpl {
 private:
-	Chess& ch;
+	Chess* ch;
 public:
-	chrImpl(Chess& c) : ch(c) {}
+	chrImpl(Chess& c) : ch(&c) { Bitboards::init(); Zobrist::init(); Evaluation::init(); }
 
-	KingPositions _kings;
-	std::array<Piece, 128> _board;
+	// Copies the game state of other; the copy belongs to c.
+	chrImpl(Chess& c, const chrImpl& other) : chrImpl(other) { ch = &c; }
+
+	// Piece on each square, indexed like Square (a8 = 0). Kept in sync with the bitboards below.
+	std::array<Piece, 64> _board;
+	std::array<Bitboard, 6> _pieces = {};
+	std::array<Bitboard, 2> _colors = {};
 	Color _turn = WHITE;
 	std::map<std::string, std::string> _header;
 	int _epSquare = -1;
 	int _halfMoves = -1;
 	int _moveNumber = 0;
 	std::vector<History> _history;
+
+	// SAN of a history move and the FEN of the position before it.
+	struct HistoryText {
+		std::string san;
+		std::string fen;
+	};
+
+	// Text of the history moves, indexed by ply and never longer than _history. Filled when a move is played
+	// with makeMove, or by the first history() or pgn() call that needs it; search and perft never touch it.
+	std::vector<HistoryText> _historyText;
+
+	inline bool _textCached(size_t ply) const {
+		return ply < _historyText.size() && !_historyText[ply].san.empty();
+	}
 	std::map<std::string, std::string> _comments;
 
 	uint16_t _castlings = 0;
 
-	std::map<std::string, std::optional<int>> _positionCount;
+	// Zobrist key of the pieces alone, kept up to date by _setPiece, _removePiece and _movePiece.
+	uint64_t _pieceKey = 0;
+
+	// Evaluation terms of the pieces (White minus Black) and the game phase, kept up to date the same way.
+	int _middlegame = 0;
+	int _endgame = 0;
+	int _phase = 0;
 
 	void _updateSetup(std::string fen);
 
+	inline Bitboard _occupied() const {
+		return _colors[0] | _colors[1];
+	}
+
+	inline Bitboard _piecesOf(Color c, PieceSymbol type) const {
+		return _colors[static_cast<int>(c)] & _pieces[static_cast<int>(type)];
+	}
+
+	inline int _kingSquare(Color c) const {
+		const Bitboard king = _piecesOf(c, KING);
+		return king ? Bitboards::lsb(king) : EMPTY;
+	}
+
+	inline void _setPiece(int sq, const Piece& p) {
+		const Bitboard b = Bitboards::square(sq);
+		_board[sq] = p;
+		_pieces[static_cast<int>(p.type)] |= b;
+		_colors[static_cast<int>(p.color)] |= b;
+		_pieceKey ^= Zobrist::piece(p, sq);
+		_middlegame += Evaluation::middlegame(p, sq);
+		_endgame += Evaluation::endgame(p, sq);
+		_phase += Evaluation::phase(p.type);
+	}
+
+	inline void _removePiece(int sq) {
+		const Piece& p = _board[sq];
+		const Bitboard b = Bitboards::square(sq);
+		_pieces[static_cast<int>(p.type)] &= ~b;
+		_colors[static_cast<int>(p.color)] &= ~b;
+		_pieceKey ^= Zobrist::piece(p, sq);
+		_middlegame -= Evaluation::middlegame(p, sq);
+		_endgame -= Evaluation::endgame(p, sq);
+		_phase -= Evaluation::phase(p.type);
+		_board[sq] = Piece();
+	}
+
+	inline void _movePiece(int from, int to) {
+		const Piece p = _board[from];
+		const Bitboard fromTo = Bitboards::square(from) | Bitboards::square(to);
+		_pieces[static_cast<int>(p.type)] ^= fromTo;
+		_colors[static_cast<int>(p.color)] ^= fromTo;
+		_pieceKey ^= Zobrist::piece(p, from) ^ Zobrist::piece(p, to);
+		_middlegame += Evaluation::middlegame(p, to) - Evaluation::middlegame(p, from);
+		_endgame += Evaluation::endgame(p, to) - Evaluation::endgame(p, from);
+		_board[from] = Piece();
+		_board[to] = p;
+	}
+
+	void _clearBoard();
+
+	// Full position key: pieces, side to move, castling rights and an en passant square that
+	// the side to move can actually capture on.
+	uint64_t _hash() const;
+
+	Bitboard _attackersTo(int sq, Bitboard occupied) const;
+
+	// Whether the side to move has a legal en passant capture. FEN only shows the square when it does.
+	bool _epCapturable() const;
+
+	// Writes the FEN of the position, NUL-terminated, into a buffer of at least FEN_BUFFER_SIZE bytes.
+	// Returns its length.
+	size_t _writeFen(char* out) const;
+
 	bool _put(PieceSymbol type, Color color, Square sq);
 
 	void _updateCastlingRights();
@@ -35,25 +128,103 @@ public:
 
 	bool _isKingAttacked(Color c);
 
-	std::vector<InternalMove> _moves(const bool& legal = true, const PieceSymbol& piece = PieceSymbol::NONE, const std::string& sq = std::string());
+	MoveList _moves(const bool& legal = true, const PieceSymbol& piece = PieceSymbol::NONE, const std::string& sq = std::string());
+
+	// Pseudo-legal moves: may leave the own king in check.
+	void _pseudoLegalMoves(MoveList& moves, PieceSymbol piece, Bitboard fromMask);
+
+	// Strictly legal moves, generated from the checkers and pinned pieces without trying each move.
+	void _legalMoves(MoveList& moves, PieceSymbol piece, Bitboard fromMask);
+
+	// Legal moves of the piece on one square, or its pseudo-legal moves when the side to move has no king.
+	void _movesFrom(MoveList& moves, int sq);
+
+	Bitboard _pinnedPieces(Color c, int kingSquare) const;
+
+	void _push(PackedMove move, PieceSymbol piece, PieceSymbol captured);
+
+	// Expands a move of the side to move into an InternalMove, reading the pieces from the board.
+	InternalMove _unpack(PackedMove move) const;
+
+	void _makeMove(PackedMove move);
+
+	// Takes back the last move and returns it, or a null move when there is no history.
+	PackedMove _undoMove();
 
-	void _push(const InternalMove& move);
+	// "+" or "#" when the move gives check or mate, otherwise an empty string.
+	const char* _checkSuffix(PackedMove move);
 
-	void _makeMove(const InternalMove& move);
+	// SAN of a move; rivals are the other squares the same kind of piece could reach its target from.
+	std::string _san(PackedMove move, Bitboard rivals);
 
-	InternalMove _undoMove();
+	std::string _moveToSan(PackedMove move, const MoveList& moves);
 
-	std::string _moveToSan(InternalMove move, std::vector<InternalMove> moves);
+	// SAN for every move in moves, appended to out. legal must hold all legal moves of the position,
+	// which is what disambiguation is worked out from.
+	void _movesToSan(const MoveList& moves, const MoveList& legal, std::vector<std::string>& out);
 
-	std::optional<InternalMove> _moveFromSan(std::string move, bool strict = false);
+	// The legal move written as SAN (or, when not strict, LAN/UCI), or a null move when there is no
+	// single such move.
+	PackedMove _moveFromSan(const std::string& move, bool strict = false);
+	PackedMove _moveFromSan(const std::string& move, const MoveList& moves, bool strict);
+
+	// Matches a tokenized move against the legal moves. Ambiguous text yields a null move.
+	PackedMove _matchMove(const Helper::MoveText& text, const MoveList& moves, bool strict) const;
 
 	Move _makePretty(InternalMove uglyMove);
 
-	int _getPositionCount(std::string fen);
+	// Resolves a SAN string or a from/to option to a legal move. Throws std::runtime_error when there is none.
+	// legal must hold the legal moves of the position.
+	PackedMove _findMove(const std::variant<std::string, MoveOption>& moveArg, const MoveList& legal, bool strict);
+
+	// Makes a legal move and caches its SAN and the FEN before it in _historyText.
+	void _playMove(PackedMove move, const MoveList& legal);
 
-	void _incPositionCount(std::string fen);
+	// Fills in the SAN and FEN of history moves that were made without them, replaying from the
+	// first such entry. Afterwards every entry can be read without touching the board.
+	void _cacheHistory();
 
-	void _decPositionCount(std::string fen);
+	// The Move for a history entry, built from its cache. Call _cacheHistory first.
+	Move _historyMove(size_t ply);
+
+	// How many times the current position has occurred since the last irreversible move.
+	int _repetitionCount() const;
 
 	void _pruneComments();
+
+	// Optional perft cache. Copies of a game share it, so parallel perft workers fill one table.
+	std::shared_ptr<PerftTable> _perftTable;
+
+	uint64_t _perft(int depth);
+
+	// Adds the leaf nodes depth plies below the current position to stats. depth must be at least 1.
+	void _perftStats(int depth, PerftStats& stats);
+
+	// Appends the move sequence to every position depth plies below the current one.
+	void _splitPoints(int depth, std::vector<PackedMove>& path, std::vector<std::vector<PackedMove>>& out);
+
+	// Static evaluation in centipawns from the side to move's view, read from the incremental terms.
+	inline int _evaluate() const {
+		return Evaluation::blend(_middlegame, _endgame, _phase, _turn);
+	}
+
+	// Transposition table for search, created on the first search. Copies of a game share it.
+	static const size_t DEFAULT_HASH_SIZE = 16;
+	std::shared_ptr<TranspositionTable> _hashTable;
+	size_t _hashSize = DEFAULT_HASH_SIZE;
+
+	// Iterative deepening driver behind Chess::search.
+	SearchResult _search(const SearchLimits& limits);
+
+	// Iterative deepening for a Lazy SMP helper thread: no result, only entries in the shared table.
+	// Adds the nodes it searches to nodes after every depth.
+	void _helperSearch(SearchState& s, int maxDepth, int helper, std::atomic<uint64_t>& nodes);
+
+	int _negamax(SearchState& s, int depth, int ply, int alpha, int beta);
+
+	// Searches captures and promotions until the position is quiet, or every evasion when in check.
+	int _quiescence(SearchState& s, int ply, int alpha, int beta);
+
+	// Ordering key of a move: first (the PV or hash move), then captures by MVV-LVA, killers, and the history heuristic.
+	int _orderScore(const SearchState& s, PackedMove move, int ply, PackedMove first) const;
 };
\ No newline at end of file
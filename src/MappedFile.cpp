@@ -0,0 +1,74 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+MappedFile::MappedFile(const std::string& path) {
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Cannot read the size of " + path);
+	}
+	_size = static_cast<size_t>(size.QuadPart);
+	if (_size == 0) return;
+
+	_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping) {
+		_data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (!_data) {
+		if (_mapping) CloseHandle(_mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Cannot map " + path);
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (_data) UnmapViewOfFile(_data);
+	if (_mapping) CloseHandle(_mapping);
+	if (_file) CloseHandle(_file);
+}
+#else
+MappedFile::MappedFile(const std::string& path) {
+	_fd = open(path.c_str(), O_RDONLY);
+	if (_fd < 0) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+
+	struct stat st;
+	if (fstat(_fd, &st) != 0) {
+		close(_fd);
+		throw std::runtime_error("Cannot read the size of " + path);
+	}
+	_size = static_cast<size_t>(st.st_size);
+	if (_size == 0) return;
+
+	void* p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (p == MAP_FAILED) {
+		close(_fd);
+		throw std::runtime_error("Cannot map " + path);
+	}
+	_data = static_cast<const char*>(p);
+}
+
+MappedFile::~MappedFile() {
+	if (_data) munmap(const_cast<char*>(_data), _size);
+	if (_fd >= 0) close(_fd);
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// A file mapped read-only into memory. The mapping lives as long as the object.
+class MappedFile {
+public:
+    /// Maps the whole file. Throws std::runtime_error when it cannot be opened or mapped.
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// Start of the file's contents, or nullptr for an empty file.
+    inline const char* data() const {
+        return _data;
+    }
+
+    inline size_t size() const {
+        return _size;
+    }
+
+private:
+    const char* _data = nullptr;
+    size_t _size = 0;
+#if defined(_WIN32)
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#else
+    int _fd = -1;
+#endif
+};
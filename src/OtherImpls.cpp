@@ -1,5 +1,4 @@
 #include "Helper.h"
-#include <set>
 
 using namespace ChessCpp;
 
@@ -30,89 +29,156 @@ Square ChessCpp::algebraic(int square) {
 	);
 }
 
-bool isValidPiecePlacement(const std::string& placement) { 
-	const std::vector<std::string> rows = Helper::split(placement, '/'); 
-	if (rows.size() != 8) return false;  
-	for (size_t i = 0; i < rows.size(); ++i) { 
-		const std::string& row = rows[i]; 
-		int sum = 0; 
-		bool lastWasDigit = false;  
-		for (char c : row) { 
-			if (std::isdigit(c)) { 
-				if (lastWasDigit) return false; 
-				sum += c - '0'; 
-				lastWasDigit = true; 
-			} 
-			else if (std::string("rnbqkpRNBQKP").find(c) != std::string::npos) { 
-				sum += 1; lastWasDigit = false; 
-			} 
-			else { 
-				return false; 
-			} 
-		} if (sum != 8) 
-			return false; 
-	}  
-	// Disallow pawns on first or last rank 
-	for (char c : rows[0] + rows[7]) { 
-		if (c == 'P' || c == 'p') return false; 
-	}  
-	return true;
-}
-
-bool isValidActiveColor(const std::string& color) { 
-	return color == "w" || color == "b";
-}
+namespace {
+	inline bool isFenSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+	}
 
-bool isValidCastlingRights(const std::string& rights) { 
-	if (rights == "-") return true;
-	static const std::string valid = "KQkq";
-	std::set<char> seen;
-	for (char c : rights) { 
-		if (valid.find(c) == std::string::npos) return false; 
-		if (!seen.insert(c).second) return false; // duplicate 
-	} 
-	return true;
+	// Reads a counter the way std::stoi does: an optional sign and at least one digit, ignoring what follows.
+	bool parseFenInteger(const char* s, size_t len, int& value) {
+		size_t i = 0;
+		const bool negative = i < len && s[i] == '-';
+		if (i < len && (s[i] == '-' || s[i] == '+')) i++;
+		if (i == len || !std::isdigit(static_cast<unsigned char>(s[i]))) return false;
+
+		int64_t v = 0;
+		for (; i < len && std::isdigit(static_cast<unsigned char>(s[i])); i++) {
+			v = v * 10 + (s[i] - '0');
+			if (v > INT32_MAX) return false;
+		}
+		value = static_cast<int>(negative ? -v : v);
+		return true;
+	}
 }
 
-bool isValidEnPassant(const std::string& ep, const std::string& turn) { 
-	if (ep == "-") return true;
-
-	if (!std::regex_match(ep, std::regex("^[a-h][36]$"))) return false;
-	char rank = ep[1];
-	if ((rank == '3' && turn == "w") || (rank == '6' && turn == "b")) return false;
+const char* parseFen(const std::string& fen, ParsedFen& out, bool padMissing, bool validate) {
+	static const char* const DEFAULT_FIELDS[] = { "-", "-", "0", "1" };
+
+	const char* field[6] = {};
+	size_t length[6] = {};
+	int count = 0;
+	for (size_t i = 0, n = fen.size(); ; ) {
+		while (i < n && isFenSpace(fen[i])) i++;
+		if (i == n) break;
+		const size_t start = i;
+		while (i < n && !isFenSpace(fen[i])) i++;
+		if (count == 6) {
+			count++;
+			break;
+		}
+		field[count] = fen.data() + start;
+		length[count] = i - start;
+		count++;
+	}
 
-	return true;
-}
+	out.fields = count;
+	if (padMissing && count >= 2 && count < 6) {
+		for (int f = count; f < 6; f++) {
+			field[f] = DEFAULT_FIELDS[f - 2];
+			length[f] = 1;
+		}
+	}
+	else if (count != 6) {
+		return "Invalid FEN: Expected 6 fields";
+	}
 
-bool isValidIntegerField(const std::string& s, bool mustBePositive) {
-	try {
-		int value = std::stoi(s);
-		return mustBePositive ? value > 0 : value >= 0;
-	} catch (...) {
-		return false;
+	// Piece placement. Squares are counted straight through the ranks, so an unvalidated FEN that
+	// overflows a rank spills into the next one, as it always has.
+	out.board = std::array<Piece, 64>();
+	bool placementValid = true;
+	int rows = 1;
+	int rowSum = 0;
+	int square = 0;
+	int whiteKings = 0;
+	int blackKings = 0;
+	bool lastWasDigit = false;
+	for (size_t i = 0; i < length[0]; i++) {
+		const char c = field[0][i];
+		if (c == '/') {
+			placementValid = placementValid && rowSum == 8;
+			rows++;
+			rowSum = 0;
+			lastWasDigit = false;
+		}
+		else if (std::isdigit(static_cast<unsigned char>(c))) {
+			placementValid = placementValid && !lastWasDigit;
+			rowSum += c - '0';
+			square += c - '0';
+			lastWasDigit = true;
+		}
+		else {
+			const PieceSymbol type = Helper::charToSymbol(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+			const bool pawnOnEdge = type == PAWN && (rows == 1 || rows == 8);
+			placementValid = placementValid && type != PieceSymbol::NONE && !pawnOnEdge;
+			if (c == 'K') whiteKings++;
+			if (c == 'k') blackKings++;
+			if (square < 64) {
+				out.board[square] = Piece(c < 'a' ? WHITE : BLACK, type);
+			}
+			rowSum++;
+			square++;
+			lastWasDigit = false;
+		}
+	}
+	placementValid = placementValid && rowSum == 8 && rows == 8;
+
+	const char turn = length[1] > 0 ? field[1][0] : ' ';
+	out.turn = turn == 'w' ? WHITE : BLACK;
+
+	bool castlingValid = length[2] > 0;
+	out.castling = 0;
+	if (!(length[2] == 1 && field[2][0] == '-')) {
+		for (size_t i = 0; i < length[2]; i++) {
+			uint16_t right = 0;
+			switch (field[2][i]) {
+			case 'K': right = CASTLE_WK; break;
+			case 'Q': right = CASTLE_WQ; break;
+			case 'k': right = CASTLE_BK; break;
+			case 'q': right = CASTLE_BQ; break;
+			default: break;
+			}
+			castlingValid = castlingValid && right && !(out.castling & right);
+			out.castling |= right;
+		}
 	}
-}
 
-bool hasExactlyOneKing(const std::string& board) {
-	int whiteKings = std::count(board.begin(), board.end(), 'K');
-	int blackKings = std::count(board.begin(), board.end(), 'k');
+	bool epValid = true;
+	out.epSquare = EMPTY;
+	if (!(length[3] == 1 && field[3][0] == '-')) {
+		const char epFile = length[3] > 0 ? field[3][0] : ' ';
+		const char epRank = length[3] > 1 ? field[3][1] : ' ';
+		epValid = length[3] == 2 && epFile >= 'a' && epFile <= 'h' &&
+			((epRank == '3' && turn == 'b') || (epRank == '6' && turn == 'w'));
+		if (epFile >= 'a' && epFile <= 'h' && epRank >= '1' && epRank <= '8') {
+			out.epSquare = ('8' - epRank) * 8 + (epFile - 'a');
+		}
+	}
 
-	return whiteKings == 1 && blackKings == 1;
+	const bool halfMovesValid = parseFenInteger(field[4], length[4], out.halfMoves);
+	const bool moveNumberValid = parseFenInteger(field[5], length[5], out.moveNumber);
+
+	if (validate) {
+		if (!placementValid) return "Invalid FEN: Bad piece placement";
+		if (length[1] != 1 || (turn != 'w' && turn != 'b')) return "Invalid FEN: Bad active color";
+		if (whiteKings != 1 || blackKings != 1) return "Invalid FEN: King count invalid";
+		if (!castlingValid) return "Invalid FEN: Bad castling rights";
+		if (!epValid) return "Invalid FEN: Bad en passant square";
+		if (!halfMovesValid || out.halfMoves < 0) return "Invalid FEN: Bad halfmove clock";
+		if (!moveNumberValid || out.moveNumber <= 0) return "Invalid FEN: Bad fullmove number";
+	}
+	else {
+		// Even unvalidated, the counters have to be numbers.
+		if (!halfMovesValid) return "Invalid FEN: Bad halfmove clock";
+		if (!moveNumberValid) return "Invalid FEN: Bad fullmove number";
+	}
+	return nullptr;
 }
 
-std::pair<bool, std::string> ChessCpp::validateFen(std::string fen) { 	
-	const std::vector<std::string> tokens = Helper::splitWithRegex(fen, R"(\s+)");
-	if (tokens.size() != 6) {
-		return { false, "Invalid FEN: Expected 6 fields" };
+std::pair<bool, std::string> ChessCpp::validateFen(std::string fen) {
+	ParsedFen parsed;
+	const char* error = parseFen(fen, parsed, false, true);
+	if (error) {
+		return { false, error };
 	}
-
-	if (!isValidPiecePlacement(tokens[0])) return { false, "Invalid FEN: Bad piece placement" };
-	if (!isValidActiveColor(tokens[1])) return { false, "Invalid FEN: Bad active color" };
-	if (!hasExactlyOneKing(tokens[0])) return { false, "Invalid FEN: King count invalid" };
-	if (!isValidCastlingRights(tokens[2])) return { false, "Invalid FEN: Bad castling rights" };
-	if (!isValidEnPassant(tokens[3], tokens[1])) return { false, "Invalid FEN: Bad en passant square" };
-	if (!isValidIntegerField(tokens[4], false)) return { false, "Invalid FEN: Bad halfmove clock" };
-	if (!isValidIntegerField(tokens[5], true)) return { false, "Invalid FEN: Bad fullmove number" };
-
 	return { true, "Successful validation" };
 }
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Fixed-size cache of perft subtree counts keyed by position hash and remaining depth.
+// Lock-free: each entry stores its key XORed with its data, so a probe that reads a key and data
+// written by two different threads fails the check and is treated as a miss.
+class PerftTable {
+public:
+    explicit PerftTable(size_t megabytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024) {
+            count *= 2;
+        }
+        _buckets.reset(new Bucket[count]);
+        _mask = count - 1;
+    }
+
+    inline bool probe(uint64_t hash, int depth, uint64_t& nodes) const {
+        const uint64_t key = _key(hash, depth);
+        const Bucket& b = _buckets[key & _mask];
+        for (const Entry& e : b.entries) {
+            const uint64_t check = e.check.load(std::memory_order_relaxed);
+            const uint64_t data = e.data.load(std::memory_order_relaxed);
+            if ((check ^ data) == key) {
+                nodes = data & NODES_MASK;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The first slot of a bucket keeps the deepest subtree seen, the second always takes the newest.
+    inline void store(uint64_t hash, int depth, uint64_t nodes) {
+        const uint64_t key = _key(hash, depth);
+        Bucket& b = _buckets[key & _mask];
+        const uint64_t data = (static_cast<uint64_t>(depth) << DEPTH_SHIFT) | (nodes & NODES_MASK);
+        const int storedDepth = static_cast<int>(b.entries[0].data.load(std::memory_order_relaxed) >> DEPTH_SHIFT);
+        Entry& e = depth >= storedDepth ? b.entries[0] : b.entries[1];
+        e.check.store(key ^ data, std::memory_order_relaxed);
+        e.data.store(data, std::memory_order_relaxed);
+    }
+
+private:
+    // The depth lives in the top byte of the data word; perft counts stay far below 2^56.
+    static const int DEPTH_SHIFT = 56;
+    static const uint64_t NODES_MASK = (1ULL << DEPTH_SHIFT) - 1;
+
+    struct Entry {
+        std::atomic<uint64_t> check{ 0 };
+        std::atomic<uint64_t> data{ 0 };
+    };
+
+    struct Bucket {
+        Entry entries[2];
+    };
+
+    // Mixes the depth into the position hash so one position can be cached at several depths.
+    static inline uint64_t _key(uint64_t hash, int depth) {
+        return hash ^ (static_cast<uint64_t>(depth) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    std::unique_ptr<Bucket[]> _buckets;
+    size_t _mask = 0;
+};
@@ -0,0 +1,193 @@
+#include "../include/pgnimport"
+#include "../include/pgnreader"
+#include "InternalImpl.h"
+#include "PgnSplitter.h"
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace ChessCpp;
+
+namespace {
+	// Games are handed to workers in batches, so the queues are touched once per batch rather than per game.
+	const size_t BATCH_GAMES = 64;
+	const size_t BATCH_BYTES = 1 << 18;
+
+	struct Batch {
+		size_t sequence = 0;
+		size_t first = 0;
+		std::string text;
+		std::vector<ImportedGame> games;
+	};
+}
+
+PgnImporter::PgnImporter(int threads, bool ordered, bool strict) : _threads(threads), _ordered(ordered), _strict(strict) {
+	if (_threads <= 0) {
+		_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+}
+
+size_t PgnImporter::run(const std::string& path, const std::function<bool(ImportedGame&)>& callback) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Cannot open " + path);
+	}
+	return run(in, callback);
+}
+
+size_t PgnImporter::run(std::istream& in, const std::function<bool(ImportedGame&)>& callback) {
+	// Batches read but not yet delivered. The reader waits above this, which bounds memory.
+	const size_t maxInFlight = static_cast<size_t>(_threads) * 4;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::unique_ptr<Batch>> pending;
+	std::map<size_t, std::unique_ptr<Batch>> done;
+	size_t inFlight = 0;
+	size_t batchesRead = 0;
+	bool readerFinished = false;
+	bool stop = false;
+
+	const auto submit = [&](std::unique_ptr<Batch> batch) {
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&]() { return inFlight < maxInFlight || stop; });
+		if (stop) return false;
+		batch->sequence = batchesRead++;
+		inFlight++;
+		pending.push_back(std::move(batch));
+		changed.notify_all();
+		return true;
+	};
+
+	std::thread reader([&]() {
+		PgnSplitter splitter;
+		std::string line;
+		size_t games = 0;
+		auto batch = std::make_unique<Batch>();
+
+		while (std::getline(in, line)) {
+			if (splitter.line(line.data(), line.size())) {
+				if (games - batch->first >= BATCH_GAMES || batch->text.size() >= BATCH_BYTES) {
+					if (!submit(std::move(batch))) break;
+					batch = std::make_unique<Batch>();
+					batch->first = games;
+				}
+				games++;
+			}
+			batch->text += line;
+			batch->text += '\n';
+		}
+		if (batch && !batch->text.empty()) {
+			submit(std::move(batch));
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		readerFinished = true;
+		changed.notify_all();
+	});
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < _threads; t++) {
+		workers.emplace_back([&]() {
+			Chess board;
+			PgnGame game;
+
+			while (true) {
+				std::unique_ptr<Batch> batch;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					changed.wait(lock, [&]() { return !pending.empty() || readerFinished || stop; });
+					if (stop || pending.empty()) return;
+					batch = std::move(pending.front());
+					pending.pop_front();
+				}
+
+				PgnReader reader(batch->text.data(), batch->text.size());
+				while (reader.next(game)) {
+					std::string error = game.error.empty() ? "" : "Invalid PGN: " + game.error;
+					try {
+						board.loadPgn(game, _strict);
+					}
+					catch (const std::exception& e) {
+						if (error.empty()) error = e.what();
+					}
+					ImportedGame imported;
+					imported.index = batch->first + batch->games.size();
+					imported.game = std::move(game);
+					imported.moves.reserve(board.chImpl->_history.size());
+					for (const History& h : board.chImpl->_history) {
+						imported.moves.push_back(h.move);
+					}
+					imported.fen = board.fen();
+					imported.error = std::move(error);
+					batch->games.push_back(std::move(imported));
+				}
+				batch->text.clear();
+				batch->text.shrink_to_fit();
+
+				std::lock_guard<std::mutex> lock(mutex);
+				done[batch->sequence] = std::move(batch);
+				changed.notify_all();
+			}
+		});
+	}
+
+	const auto finish = [&]() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+			changed.notify_all();
+		}
+		reader.join();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	};
+
+	size_t delivered = 0;
+	size_t nextSequence = 0;
+	bool cancelled = false;
+	try {
+		while (!cancelled) {
+			std::unique_ptr<Batch> batch;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				const auto ready = [&]() {
+					return _ordered ? done.count(nextSequence) > 0 : !done.empty();
+				};
+				changed.wait(lock, [&]() { return ready() || (readerFinished && nextSequence == batchesRead); });
+				if (!ready()) break;
+
+				auto it = _ordered ? done.find(nextSequence) : done.begin();
+				batch = std::move(it->second);
+				done.erase(it);
+				nextSequence++;
+			}
+
+			for (auto& game : batch->games) {
+				delivered++;
+				if (!callback(game)) {
+					cancelled = true;
+					break;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			inFlight--;
+			changed.notify_all();
+		}
+	}
+	catch (...) {
+		finish();
+		throw;
+	}
+
+	finish();
+	return delivered;
+}
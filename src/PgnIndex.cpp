@@ -0,0 +1,271 @@
+#include "../include/pgnindex"
+#include "../include/pgnreader"
+#include "MappedFile.h"
+#include "PgnSplitter.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace ChessCpp;
+
+namespace {
+	const char SIDECAR_MAGIC[8] = { 'C', 'C', 'P', 'G', 'N', 'I', 'D', 'X' };
+	const uint32_t SIDECAR_VERSION = 1;
+
+	// Tags kept for each game, in the order their values are stored.
+	const char* const INDEXED_TAGS[] = { "White", "Black", "Result", "ECO", "Date" };
+	const int TAG_COUNT = 5;
+	const size_t MAX_TAG_VALUE = 255;
+
+	struct Record {
+		uint64_t offset;
+		uint64_t tags;      // Start of the game's tag values in the string pool.
+		uint32_t length;
+		uint32_t reserved;
+	};
+
+	// Sidecar layout: this header, then the records, then the string pool. Written in native byte order.
+	struct SidecarHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t reserved;
+		uint64_t fileSize;
+		int64_t fileTime;
+		uint64_t games;
+		uint64_t poolSize;
+	};
+
+	inline bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	int64_t modificationTime(const std::string& path) {
+		std::error_code ec;
+		const auto time = std::filesystem::last_write_time(path, ec);
+		return ec ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+	}
+}
+
+class PgnIndex::Impl {
+public:
+	explicit Impl(const std::string& path) : file(path) {}
+
+	MappedFile file;
+	std::vector<Record> records;
+	std::vector<char> pool;     // Length-prefixed tag values, TAG_COUNT per game.
+	bool fromSidecar = false;
+
+	void scan();
+	bool readSidecar(const std::string& path, int64_t fileTime);
+	bool validRecords() const;
+	void writeSidecar(const std::string& path, int64_t fileTime) const;
+
+	const Record& record(size_t n) const {
+		if (n >= records.size()) {
+			throw std::out_of_range("No game " + std::to_string(n) + " in the PGN index");
+		}
+		return records[n];
+	}
+
+private:
+	void addGame(size_t start, size_t end, std::string (&values)[TAG_COUNT]);
+};
+
+void PgnIndex::Impl::addGame(size_t start, size_t end, std::string (&values)[TAG_COUNT]) {
+	records.push_back(Record{ start, pool.size(), static_cast<uint32_t>(end - start), 0 });
+	for (auto& value : values) {
+		pool.push_back(static_cast<char>(value.size()));
+		pool.insert(pool.end(), value.begin(), value.end());
+		value.clear();
+	}
+}
+
+void PgnIndex::Impl::scan() {
+	const char* data = file.data();
+	const size_t size = file.size();
+
+	PgnSplitter splitter;
+	std::string values[TAG_COUNT];
+	size_t gameStart = std::string::npos;
+
+	size_t pos = 0;
+	while (pos < size) {
+		const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+		const size_t lineEnd = nl ? static_cast<size_t>(nl - data) : size;
+
+		if (splitter.line(data + pos, lineEnd - pos)) {
+			if (gameStart != std::string::npos) {
+				addGame(gameStart, pos, values);
+			}
+			gameStart = pos;
+		}
+
+		if (splitter.tag()) {
+			// Tag name, then the quoted value with its escapes.
+			size_t i = pos;
+			while (data[i] != '[') i++;
+			i++;
+			while (i < lineEnd && isBlank(data[i])) i++;
+			const size_t nameStart = i;
+			while (i < lineEnd && !isBlank(data[i]) && data[i] != '"') i++;
+			const size_t nameLength = i - nameStart;
+			while (i < lineEnd && data[i] != '"') i++;
+
+			for (int t = 0; t < TAG_COUNT; t++) {
+				if (nameLength == std::strlen(INDEXED_TAGS[t]) && std::memcmp(data + nameStart, INDEXED_TAGS[t], nameLength) == 0) {
+					std::string& value = values[t];
+					value.clear();
+					for (i++; i < lineEnd && data[i] != '"'; i++) {
+						if (data[i] == '\\' && i + 1 < lineEnd) i++;
+						if (value.size() < MAX_TAG_VALUE) value += data[i];
+					}
+					break;
+				}
+			}
+		}
+		pos = nl ? lineEnd + 1 : size;
+	}
+
+	if (gameStart != std::string::npos) {
+		addGame(gameStart, size, values);
+	}
+}
+
+bool PgnIndex::Impl::readSidecar(const std::string& path, int64_t fileTime) {
+	std::ifstream in(path + ".idx", std::ios::binary | std::ios::ate);
+	if (!in) return false;
+	const uint64_t sidecarSize = static_cast<uint64_t>(in.tellg());
+	in.seekg(0);
+
+	SidecarHeader header;
+	if (sidecarSize < sizeof(header) ||
+		!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		std::memcmp(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0 ||
+		header.version != SIDECAR_VERSION ||
+		header.fileSize != file.size() ||
+		header.fileTime != fileTime) {
+		return false;
+	}
+
+	// The counts must account for the sidecar's exact length before anything is allocated from them.
+	const uint64_t body = sidecarSize - sizeof(header);
+	if (header.games > body / sizeof(Record) || header.poolSize != body - header.games * sizeof(Record)) {
+		return false;
+	}
+
+	records.resize(static_cast<size_t>(header.games));
+	pool.resize(static_cast<size_t>(header.poolSize));
+	if (!in.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record))) ||
+		!in.read(pool.data(), static_cast<std::streamsize>(pool.size())) ||
+		!validRecords()) {
+		records.clear();
+		pool.clear();
+		return false;
+	}
+	return true;
+}
+
+// A sidecar left from an edit made within the same second as the last one, or damaged on disk, can
+// still point outside the PGN or the pool; every record is checked before any is used.
+bool PgnIndex::Impl::validRecords() const {
+	for (const Record& r : records) {
+		if (r.offset > file.size() || r.length > file.size() - r.offset) {
+			return false;
+		}
+		uint64_t p = r.tags;
+		for (int t = 0; t < TAG_COUNT; t++) {
+			if (p >= pool.size()) return false;
+			p += 1 + static_cast<unsigned char>(pool[static_cast<size_t>(p)]);
+		}
+		if (p > pool.size()) return false;
+	}
+	return true;
+}
+
+void PgnIndex::Impl::writeSidecar(const std::string& path, int64_t fileTime) const {
+	SidecarHeader header = {};
+	std::memcpy(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+	header.version = SIDECAR_VERSION;
+	header.fileSize = file.size();
+	header.fileTime = fileTime;
+	header.games = records.size();
+	header.poolSize = pool.size();
+
+	// The sidecar is only a cache, so a directory we cannot write to is not an error.
+	std::ofstream out(path + ".idx", std::ios::binary | std::ios::trunc);
+	if (!out) return;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(Record)));
+	out.write(pool.data(), static_cast<std::streamsize>(pool.size()));
+}
+
+PgnIndex::PgnIndex(const std::string& path, bool writeSidecar) : _impl(new Impl(path)) {
+	const int64_t fileTime = modificationTime(path);
+	if (_impl->readSidecar(path, fileTime)) {
+		_impl->fromSidecar = true;
+		return;
+	}
+
+	_impl->scan();
+	if (writeSidecar) {
+		_impl->writeSidecar(path, fileTime);
+	}
+}
+
+PgnIndex::~PgnIndex() {
+	delete _impl;
+}
+
+size_t PgnIndex::size() const {
+	return _impl->records.size();
+}
+
+PgnIndexEntry PgnIndex::entry(size_t n) const {
+	const Record& r = _impl->record(n);
+	PgnIndexEntry e;
+	e.offset = r.offset;
+	e.length = r.length;
+
+	std::string* fields[TAG_COUNT] = { &e.white, &e.black, &e.result, &e.eco, &e.date };
+	const char* p = _impl->pool.data() + r.tags;
+	for (auto* field : fields) {
+		const size_t len = static_cast<unsigned char>(*p++);
+		field->assign(p, len);
+		p += len;
+	}
+	return e;
+}
+
+std::string PgnIndex::text(size_t n) const {
+	const Record& r = _impl->record(n);
+	return std::string(_impl->file.data() + r.offset, r.length);
+}
+
+PgnGame PgnIndex::game(size_t n) const {
+	const Record& r = _impl->record(n);
+	PgnReader reader(_impl->file.data() + r.offset, r.length);
+	PgnGame game;
+	reader.next(game);
+	return game;
+}
+
+void PgnIndex::load(size_t n, Chess& board, bool strict) const {
+	const PgnGame g = game(n);
+	if (!g.error.empty()) {
+		throw std::runtime_error("Invalid PGN: " + g.error);
+	}
+	board.loadPgn(g, strict);
+}
+
+bool PgnIndex::fromSidecar() const {
+	return _impl->fromSidecar;
+}
+
+size_t PgnIndex::build(const std::string& path) {
+	Impl impl(path);
+	impl.scan();
+	impl.writeSidecar(path, modificationTime(path));
+	return impl.records.size();
+}
@@ -0,0 +1,262 @@
+#include "../include/pgnreader"
+#include "Helper.h"
+#include <cerrno>
+
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace ChessCpp;
+
+namespace {
+	inline bool isSpace(int c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+	}
+
+	// Characters that end a movetext symbol on their own.
+	inline bool isDelimiter(int c) {
+		return isSpace(c) || c == '{' || c == '}' || c == '(' || c == ')' || c == '[' || c == ']' || c == ';' || c == '$';
+	}
+}
+
+PgnReader::PgnReader(std::istream& in) : _in(&in), _buffer(BUFFER_SIZE) {
+	_token.reserve(MAX_TOKEN + 1);
+}
+
+PgnReader::PgnReader(int fd) : _fd(fd), _buffer(BUFFER_SIZE) {
+	_token.reserve(MAX_TOKEN + 1);
+}
+
+PgnReader::PgnReader(const char* data, size_t size) : _data(data), _end(size), _eof(true) {
+	_token.reserve(MAX_TOKEN + 1);
+}
+
+size_t PgnReader::gamesRead() const {
+	return _games;
+}
+
+bool PgnReader::_fill() {
+	if (_eof) return false;
+
+	_data = _buffer.data();
+	long long n = 0;
+	if (_in) {
+		_in->read(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+		n = static_cast<long long>(_in->gcount());
+	}
+	else {
+		do {
+#if defined(_MSC_VER)
+			n = _read(_fd, _buffer.data(), static_cast<unsigned>(_buffer.size()));
+#else
+			n = ::read(_fd, _buffer.data(), _buffer.size());
+#endif
+		} while (n < 0 && errno == EINTR);
+	}
+
+	if (n <= 0) {
+		_eof = true;
+		return false;
+	}
+	_pos = 0;
+	_end = static_cast<size_t>(n);
+	return true;
+}
+
+int PgnReader::_peek() {
+	if (_pos == _end && !_fill()) return EOF;
+	return static_cast<unsigned char>(_data[_pos]);
+}
+
+int PgnReader::_get() {
+	const int c = _peek();
+	if (c == EOF) return EOF;
+	_pos++;
+	_lineStart = c == '\n';
+	if (_lineStart) _line++;
+	return c;
+}
+
+void PgnReader::_skipLine() {
+	int c;
+	do {
+		c = _get();
+	} while (c != EOF && c != '\n');
+}
+
+void PgnReader::_error(PgnGame& game, const std::string& message, size_t line) {
+	if (game.error.empty()) {
+		game.error = "line " + std::to_string(line ? line : _line) + ": " + message;
+	}
+}
+
+bool PgnReader::_readHeader(PgnGame& game) {
+	_get();
+	while (_peek() == ' ' || _peek() == '\t') _get();
+
+	std::string tag;
+	while (std::isalnum(_peek()) || _peek() == '_') {
+		tag += static_cast<char>(_get());
+	}
+	while (_peek() == ' ' || _peek() == '\t') _get();
+	if (tag.empty() || _peek() != '"') {
+		return false;
+	}
+	_get();
+
+	// Values cannot span lines, so a missing quote is caught at the end of the line.
+	std::string value;
+	for (int c = _get(); c != '"'; c = _get()) {
+		if (c == EOF || c == '\n') return false;
+		if (c == '\\') {
+			c = _get();
+			if (c == EOF || c == '\n') return false;
+		}
+		value += static_cast<char>(c);
+	}
+	while (_peek() == ' ' || _peek() == '\t') _get();
+	if (_peek() != ']') {
+		return false;
+	}
+	_get();
+
+	game.headers.emplace_back(std::move(tag), std::move(value));
+	return true;
+}
+
+void PgnReader::_readToken() {
+	_token.clear();
+	while (_peek() != EOF && !isDelimiter(_peek())) {
+		const char c = static_cast<char>(_get());
+		if (_token.size() <= MAX_TOKEN) _token += c;
+	}
+}
+
+void PgnReader::_addToken(PgnGame& game, bool mainLine) {
+	if (_token.size() > MAX_TOKEN) {
+		_error(game, "token too long");
+		return;
+	}
+
+	// Move numbers may be written on their own ("12.", "12...") or stuck to the move ("12.e4").
+	size_t start = 0;
+	while (start < _token.size() && std::isdigit(static_cast<unsigned char>(_token[start]))) start++;
+	const bool number = start > 0 && start < _token.size() && _token[start] == '.';
+	if (!number) start = 0;
+	while (start < _token.size() && _token[start] == '.') start++;
+	if (start == _token.size() || !mainLine) return;
+
+	if (start > 0) _token.erase(0, start);
+
+	Helper::MoveText text;
+	if (!Helper::parseMove(_token, text, false) && !Helper::parseMove(_token, text, false, true)) {
+		_error(game, "unexpected token '" + _token + "'");
+		return;
+	}
+	game.moves.push_back(_token);
+}
+
+bool PgnReader::next(PgnGame& game) {
+	game.headers.clear();
+	game.moves.clear();
+	game.result.clear();
+	game.error.clear();
+	game.line = 0;
+
+	bool started = false;
+	bool inMoves = false;
+	int depth = 0;
+
+	for (int c = _peek(); c != EOF; c = _peek()) {
+		if (isSpace(c)) {
+			_get();
+			continue;
+		}
+		// A '%' in the first column escapes the rest of the line.
+		if (c == '%' && _lineStart) {
+			_skipLine();
+			continue;
+		}
+		if (c == '[' && inMoves) {
+			// The next game's tags, so this game ended without a termination marker.
+			if (depth > 0) _error(game, "unterminated variation");
+			break;
+		}
+		if (!started) {
+			started = true;
+			game.line = _line;
+		}
+
+		switch (c) {
+		case '[': {
+			const size_t line = _line;
+			if (!_readHeader(game)) {
+				_error(game, "malformed tag pair", line);
+				if (!_lineStart) _skipLine();
+			}
+			break;
+		}
+		case '{':
+			_get();
+			for (c = _get(); c != '}' && c != EOF; c = _get()) {}
+			if (c == EOF) _error(game, "unterminated comment");
+			break;
+		case ';':
+			_skipLine();
+			break;
+		case '(':
+			_get();
+			depth++;
+			inMoves = true;
+			break;
+		case ')':
+			_get();
+			if (depth == 0) {
+				_error(game, "unexpected ')'");
+			}
+			else {
+				depth--;
+			}
+			break;
+		case '$':
+			_get();
+			while (std::isdigit(_peek())) _get();
+			inMoves = true;
+			break;
+		case ']':
+		case '}':
+			_get();
+			_error(game, std::string("unexpected '") + static_cast<char>(c) + "'");
+			break;
+		default:
+			_readToken();
+			inMoves = true;
+			if (depth == 0 && std::find(TERMINATION_MARKERS.begin(), TERMINATION_MARKERS.end(), _token) != TERMINATION_MARKERS.end()) {
+				game.result = _token;
+				_games++;
+				return true;
+			}
+			_addToken(game, depth == 0);
+			break;
+		}
+	}
+
+	if (!started) {
+		return false;
+	}
+	if (depth > 0) _error(game, "unterminated variation");
+	_games++;
+	return true;
+}
+
+size_t PgnReader::forEach(const std::function<bool(const PgnGame&)>& callback) {
+	PgnGame game;
+	size_t count = 0;
+	while (next(game)) {
+		count++;
+		if (!callback(game)) break;
+	}
+	return count;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+// Finds where the games of a PGN text start, one line at a time and without tokenizing moves.
+// A game starts at its first tag pair after movetext, or at movetext that follows a termination
+// marker. Brace comments are tracked so that text inside them is never taken for a tag pair.
+class PgnSplitter {
+public:
+    /// Takes the next line, without its line break.
+    /// @return true when a new game starts on this line.
+    inline bool line(const char* text, size_t length) {
+        _tag = false;
+        size_t i = 0;
+        bool starts = false;
+
+        if (!_inComment) {
+            while (i < length && isBlank(text[i])) i++;
+            if (i == length || (i == 0 && text[0] == '%')) {
+                return false;
+            }
+
+            if (text[i] == '[') {
+                starts = _sawMoves || !_started;
+                if (starts) _afterResult = false;
+                _started = true;
+                _sawMoves = false;
+                _tag = true;
+                return starts;
+            }
+
+            starts = _afterResult || !_started;
+            _started = true;
+        }
+        _sawMoves = true;
+
+        // Comments, and the last symbol on the line to spot a termination marker.
+        size_t tokenStart = 0;
+        size_t tokenEnd = 0;
+        for (; i < length; i++) {
+            const char c = text[i];
+            if (_inComment) {
+                _inComment = c != '}';
+            }
+            else if (c == '{') {
+                _inComment = true;
+            }
+            else if (c == ';') {
+                break;
+            }
+            else if (!isBlank(c) && c != '(' && c != ')' && c != '}') {
+                if (tokenEnd != i) tokenStart = i;
+                tokenEnd = i + 1;
+            }
+        }
+        _afterResult = !_inComment && isTerminationMarker(text + tokenStart, tokenEnd - tokenStart);
+        return starts;
+    }
+
+    /// Whether the last line was a tag pair.
+    inline bool tag() const {
+        return _tag;
+    }
+
+private:
+    static inline bool isBlank(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static inline bool isTerminationMarker(const char* s, size_t len) {
+        switch (len) {
+        case 1: return s[0] == '*';
+        case 3: return std::memcmp(s, "1-0", 3) == 0 || std::memcmp(s, "0-1", 3) == 0;
+        case 7: return std::memcmp(s, "1/2-1/2", 7) == 0;
+        default: return false;
+        }
+    }
+
+    bool _started = false;
+    bool _inComment = false;
+    bool _sawMoves = false;
+    bool _afterResult = false;
+    bool _tag = false;
+};
@@ -0,0 +1,321 @@
+#include "InternalImpl.h"
+#include <thread>
+
+using namespace ChessCpp;
+
+namespace {
+	// Rough piece values for ordering captures, indexed by PieceSymbol.
+	const int PIECE_VALUES[6] = { 100, 320, 330, 500, 900, 0 };
+
+	// Move ordering bands, highest first. History scores stay below KILLER_SCORE.
+	const int PV_SCORE = 1 << 30;
+	const int CAPTURE_SCORE = 1 << 28;
+	const int KILLER_SCORE = 1 << 24;
+	const int HISTORY_LIMIT = 1 << 20;
+
+	// Moves the best remaining move to index i. Cheaper than a full sort, since most nodes cut off early.
+	void pickMove(MoveList& moves, int* scores, size_t i) {
+		size_t best = i;
+		for (size_t j = i + 1; j < moves.size(); j++) {
+			if (scores[j] > scores[best]) best = j;
+		}
+		if (best != i) {
+			std::swap(moves[i], moves[best]);
+			std::swap(scores[i], scores[best]);
+		}
+	}
+
+	// Mate scores count plies from the root, but a table entry can be reached at any ply, so they are
+	// stored counting from the entry's own position instead.
+	int scoreToTable(int score, int ply) {
+		if (score >= SearchState::MATE_BOUND) return score + ply;
+		if (score <= -SearchState::MATE_BOUND) return score - ply;
+		return score;
+	}
+
+	int scoreFromTable(int score, int ply) {
+		if (score >= SearchState::MATE_BOUND) return score - ply;
+		if (score <= -SearchState::MATE_BOUND) return score + ply;
+		return score;
+	}
+
+	std::optional<int> mateDistance(int score) {
+		if (score >= SearchState::MATE_BOUND) return (SearchState::MATE_SCORE - score + 1) / 2;
+		if (score <= -SearchState::MATE_BOUND) return -(SearchState::MATE_SCORE + score) / 2;
+		return std::nullopt;
+	}
+}
+
+int Chess::chrImpl::_orderScore(const SearchState& s, PackedMove m, int ply, PackedMove first) const {
+	if (m == first) return PV_SCORE;
+
+	if (m.isCapture() || m.isPromotion()) {
+		const PieceSymbol victim = m.isEnPassant() ? PAWN : _board[m.to()].type;
+		const int attacker = static_cast<int>(_board[m.from()].type);
+		int score = CAPTURE_SCORE - attacker;
+		if (victim != PieceSymbol::NONE) score += PIECE_VALUES[static_cast<int>(victim)] * 8;
+		if (m.isPromotion()) score += PIECE_VALUES[static_cast<int>(m.promotion())] * 8;
+		return score;
+	}
+	if (m == s.killers[ply][0]) return KILLER_SCORE;
+	if (m == s.killers[ply][1]) return KILLER_SCORE - 1;
+	return s.history[static_cast<int>(_turn)][m.from()][m.to()];
+}
+
+int Chess::chrImpl::_quiescence(SearchState& s, int ply, int alpha, int beta) {
+	s.pvLength[ply] = 0;
+	if (s.poll()) return 0;
+	s.nodes++;
+	if (ply > s.selDepth) s.selDepth = ply;
+	if (ply >= SearchState::MAX_PLY - 1) return _evaluate();
+
+	const bool inCheck = _isKingAttacked(_turn);
+	int best = -SearchState::INFINITE_SCORE;
+	if (!inCheck) {
+		// Standing pat: the side to move is assumed to have at least one quiet move as good as the static score.
+		best = _evaluate();
+		if (best >= beta) return best;
+		if (best > alpha) alpha = best;
+	}
+
+	MoveList moves;
+	_legalMoves(moves, PieceSymbol::NONE, ~0ULL);
+	if (inCheck && moves.empty()) return -SearchState::MATE_SCORE + ply;
+
+	int* scores = s.scores[ply];
+	for (size_t i = 0; i < moves.size(); i++) {
+		const bool tactical = moves[i].isCapture() || moves[i].isPromotion();
+		scores[i] = inCheck || tactical ? _orderScore(s, moves[i], ply, PackedMove()) : INT32_MIN;
+	}
+
+	for (size_t i = 0; i < moves.size(); i++) {
+		pickMove(moves, scores, i);
+		if (scores[i] == INT32_MIN) break;
+
+		_makeMove(moves[i]);
+		const int score = -_quiescence(s, ply + 1, -beta, -alpha);
+		_undoMove();
+		if (s.stopped) return 0;
+
+		if (score > best) {
+			best = score;
+			if (score > alpha) {
+				alpha = score;
+				if (score >= beta) break;
+			}
+		}
+	}
+	return best;
+}
+
+int Chess::chrImpl::_negamax(SearchState& s, int depth, int ply, int alpha, int beta) {
+	s.pvLength[ply] = 0;
+	if (ply > 0 && (_halfMoves >= 100 || _repetitionCount() > 1)) return 0;
+	if (ply >= SearchState::MAX_PLY - 1) return _evaluate();
+
+	// Check extension: a checked side has few replies, and this keeps forced lines from ending mid-attack.
+	const bool inCheck = _isKingAttacked(_turn);
+	if (inCheck) depth++;
+	if (depth <= 0) return _quiescence(s, ply, alpha, beta);
+
+	if (s.poll()) return 0;
+	s.nodes++;
+
+	const uint64_t key = _hash();
+	TranspositionTable::Hit hit;
+	PackedMove hashMove;
+	if (s.table && s.table->probe(key, hit)) {
+		hashMove = hit.move;
+		if (ply > 0 && hit.depth >= depth) {
+			const int score = scoreFromTable(hit.score, ply);
+			if (hit.bound == TranspositionTable::EXACT ||
+				(hit.bound == TranspositionTable::LOWER && score >= beta) ||
+				(hit.bound == TranspositionTable::UPPER && score <= alpha)) {
+				if (hit.bound == TranspositionTable::EXACT && hashMove) {
+					s.pv[ply][0] = hashMove;
+					s.pvLength[ply] = 1;
+				}
+				return score;
+			}
+		}
+	}
+
+	MoveList moves;
+	_legalMoves(moves, PieceSymbol::NONE, ~0ULL);
+	if (moves.empty()) return inCheck ? -SearchState::MATE_SCORE + ply : 0;
+
+	PackedMove pvMove;
+	if (s.followPv) {
+		if (ply < s.lastPvLength) pvMove = s.lastPv[ply];
+		else s.followPv = false;
+	}
+
+	int* scores = s.scores[ply];
+	for (size_t i = 0; i < moves.size(); i++) {
+		scores[i] = _orderScore(s, moves[i], ply, pvMove ? pvMove : hashMove);
+	}
+
+	const int us = static_cast<int>(_turn);
+	const int alphaStart = alpha;
+	PackedMove bestMove;
+	int best = -SearchState::INFINITE_SCORE;
+	for (size_t i = 0; i < moves.size(); i++) {
+		pickMove(moves, scores, i);
+		const PackedMove m = moves[i];
+
+		_makeMove(m);
+		const int score = -_negamax(s, depth - 1, ply + 1, -beta, -alpha);
+		_undoMove();
+		// Only the first move at each ply can continue the previous iteration's PV.
+		s.followPv = false;
+		if (s.stopped) return 0;
+
+		if (score <= best) continue;
+		best = score;
+		if (score <= alpha) continue;
+		alpha = score;
+		bestMove = m;
+
+		s.pv[ply][0] = m;
+		for (int j = 0; j < s.pvLength[ply + 1]; j++) {
+			s.pv[ply][j + 1] = s.pv[ply + 1][j];
+		}
+		s.pvLength[ply] = s.pvLength[ply + 1] + 1;
+
+		if (score >= beta) {
+			if (!m.isCapture() && !m.isPromotion()) {
+				if (s.killers[ply][0] != m) {
+					s.killers[ply][1] = s.killers[ply][0];
+					s.killers[ply][0] = m;
+				}
+				int& h = s.history[us][m.from()][m.to()];
+				h += depth * depth;
+				if (h >= HISTORY_LIMIT) {
+					for (auto& from : s.history[us]) {
+						for (int& value : from) value /= 2;
+					}
+				}
+			}
+			break;
+		}
+	}
+
+	if (s.table) {
+		const TranspositionTable::Bound bound = best >= beta ? TranspositionTable::LOWER :
+			best > alphaStart ? TranspositionTable::EXACT : TranspositionTable::UPPER;
+		s.table->store(key, bestMove, scoreToTable(best, ply), depth, bound);
+	}
+	return best;
+}
+
+void Chess::chrImpl::_helperSearch(SearchState& s, int maxDepth, int helper, std::atomic<uint64_t>& nodes) {
+	// Odd helpers run a ply ahead of the others, so the threads spread over two depths at once.
+	uint64_t reported = 0;
+	for (int depth = 1 + (helper & 1); depth <= maxDepth && !s.stopped; depth++) {
+		_negamax(s, depth, 0, -SearchState::INFINITE_SCORE, SearchState::INFINITE_SCORE);
+		nodes += s.nodes - reported;
+		reported = s.nodes;
+	}
+	nodes += s.nodes - reported;
+}
+
+SearchResult Chess::chrImpl::_search(const SearchLimits& limits) {
+	// Heap-allocated: the ordering tables are too large to put on a worker thread's stack.
+	std::unique_ptr<SearchState> state(new SearchState());
+	SearchState& s = *state;
+	s.start = std::chrono::steady_clock::now();
+	s.nodeLimit = limits.nodes;
+	s.stop = limits.stop;
+	if (_hashSize > 0 && !_hashTable) {
+		_hashTable = std::make_shared<TranspositionTable>(_hashSize);
+	}
+	if (_hashTable) {
+		_hashTable->newSearch();
+		s.table = _hashTable.get();
+	}
+	if (limits.movetime > 0) {
+		s.timed = true;
+		s.deadline = s.start + std::chrono::milliseconds(limits.movetime);
+	}
+	const int maxDepth = limits.depth > 0 ? std::min(limits.depth, SearchState::MAX_PLY - 1) : SearchState::MAX_PLY - 1;
+
+	SearchResult result;
+	MoveList rootMoves;
+	_legalMoves(rootMoves, PieceSymbol::NONE, ~0ULL);
+	if (rootMoves.empty()) {
+		if (_isKingAttacked(_turn)) {
+			result.score = -SearchState::MATE_SCORE;
+			result.mate = 0;
+		}
+		return result;
+	}
+	// Something legal to play even if the first iteration is cut short.
+	result.bestMove = Helper::moveToLan(rootMoves[0]);
+
+	// Lazy SMP: helpers search the same root on their own copies of the game, and only share the
+	// transposition table. The result always comes from this thread; the helpers fill the table with
+	// results it can reuse. Copies are made here, before this thread starts changing the board.
+	int threads = limits.threads;
+	if (threads <= 0) {
+		threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+	if (!s.table) threads = 1;
+
+	std::atomic<bool> helpersStop{ false };
+	std::atomic<uint64_t> helperNodes{ 0 };
+	std::vector<std::unique_ptr<Chess>> positions;
+	std::vector<std::thread> helpers;
+	for (int i = 1; i < threads; i++) {
+		positions.emplace_back(new Chess(*ch));
+	}
+	for (int i = 1; i < threads; i++) {
+		helpers.emplace_back([&, i]() {
+			std::unique_ptr<SearchState> helperState(new SearchState());
+			helperState->start = s.start;
+			helperState->stop = &helpersStop;
+			helperState->table = s.table;
+			positions[i - 1]->chImpl->_helperSearch(*helperState, maxDepth, i, helperNodes);
+		});
+	}
+
+	for (int depth = 1; depth <= maxDepth; depth++) {
+		s.selDepth = 0;
+		s.followPv = true;
+		const int score = _negamax(s, depth, 0, -SearchState::INFINITE_SCORE, SearchState::INFINITE_SCORE);
+		// An unfinished iteration may not have looked at the best move yet, so it is dropped.
+		if (s.stopped && result.depth > 0) break;
+		if (s.pvLength[0] == 0) break;
+
+		s.lastPvLength = s.pvLength[0];
+		std::copy(s.pv[0], s.pv[0] + s.pvLength[0], s.lastPv);
+
+		result.depth = depth;
+		result.selDepth = std::max(depth, s.selDepth);
+		result.score = score;
+		result.mate = mateDistance(score);
+		result.nodes = s.nodes + helperNodes;
+		result.time = s.elapsed();
+		result.hashfull = s.table ? s.table->hashfull() : 0;
+		result.pv.clear();
+		for (int i = 0; i < s.pvLength[0]; i++) {
+			result.pv.push_back(Helper::moveToLan(s.pv[0][i]));
+		}
+		result.bestMove = result.pv.front();
+		if (limits.onIteration) limits.onIteration(result);
+
+		if (s.stopped) break;
+		// A mate within the searched depth cannot be improved on by searching deeper.
+		if (result.mate) {
+			const int mate = result.mate.value();
+			if ((mate > 0 ? 2 * mate - 1 : -2 * mate) <= depth) break;
+		}
+	}
+
+	helpersStop = true;
+	for (auto& t : helpers) {
+		t.join();
+	}
+	result.nodes = s.nodes + helperNodes;
+	result.time = s.elapsed();
+	return result;
+}
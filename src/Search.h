@@ -0,0 +1,66 @@
+#pragma once
+#include "../include/libtypes"
+#include "TranspositionTable.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace ChessCpp;
+
+// State of one Chess::search call: move ordering tables, the principal variation and the stop conditions.
+// Scores are centipawns from the side to move's view; a mate n plies from the root scores MATE_SCORE - n.
+struct SearchState {
+    static const int MAX_PLY = 64;
+    static const int INFINITE_SCORE = 32000;
+    static const int MATE_SCORE = 31000;
+    static const int MATE_BOUND = MATE_SCORE - MAX_PLY;     // Scores beyond this are mates.
+
+    // Triangular PV table: pv[ply] holds the best line found from ply onwards.
+    PackedMove pv[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY] = {};
+
+    // The previous iteration's PV, searched first while the current path still follows it.
+    PackedMove lastPv[MAX_PLY];
+    int lastPvLength = 0;
+    bool followPv = false;
+
+    // Shared with other searches of the same game; null when the game's hash size is 0.
+    TranspositionTable* table = nullptr;
+
+    // Move ordering scores for the moves of each ply, kept here rather than on the stack since a
+    // move list can hold MoveList::MAX_MOVES entries.
+    int scores[MAX_PLY][MoveList::MAX_MOVES];
+
+    PackedMove killers[MAX_PLY][2];
+    int history[2][64][64] = {};
+
+    uint64_t nodes = 0;
+    int selDepth = 0;
+    bool stopped = false;
+
+    uint64_t nodeLimit = 0;
+    bool timed = false;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point deadline;
+    const std::atomic<bool>* stop = nullptr;
+
+    // True once a limit is hit. The clock and the stop flag are only read every CHECK_INTERVAL nodes.
+    inline bool poll() {
+        if (stopped) return true;
+        if (nodeLimit && nodes >= nodeLimit) {
+            stopped = true;
+        }
+        else if ((nodes & (CHECK_INTERVAL - 1)) == 0) {
+            stopped = (stop && stop->load(std::memory_order_relaxed)) ||
+                (timed && std::chrono::steady_clock::now() >= deadline);
+        }
+        return stopped;
+    }
+
+    inline int64_t elapsed() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    static const uint64_t CHECK_INTERVAL = 2048;
+};
@@ -0,0 +1,616 @@
+#include "../include/tablebase"
+#include "InternalImpl.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace ChessCpp;
+
+namespace {
+	const char TABLE_MAGIC[8] = { 'C', 'C', 'T', 'B', 'A', 'S', 'E', 0 };
+	const uint32_t TABLE_VERSION = 1;
+	const char* const TABLE_EXTENSION = ".cctb";
+
+	// A position's byte is its distance to mate in plies, which is odd when the side to move mates
+	// and even when it is mated. Draws, illegal positions and (while generating) undecided ones are 255.
+	const uint8_t UNDECIDED = 255;
+	const int MAX_DISTANCE = 254;
+
+	// Table file layout: this header, then one byte per position.
+	struct TableHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t pieces;
+		char material[8];
+	};
+
+	const int PIECE_VALUES[6] = { 1, 3, 3, 5, 9, 0 };
+
+	// A table's pieces: the stronger side's as White, then Black's, each side from its king down.
+	typedef std::vector<Piece> Material;
+
+	inline bool slotOrder(const Piece& a, const Piece& b) {
+		if (a.color != b.color) return a.color == WHITE;
+		return static_cast<int>(a.type) > static_cast<int>(b.type);
+	}
+
+	// Material value of a side, and its piece types from the most valuable down.
+	int strength(const Piece* pieces, int n, Color side, int (&types)[Tablebase::MAX_PIECES], int& count) {
+		int total = 0;
+		count = 0;
+		for (int i = 0; i < n; i++) {
+			if (pieces[i].color != side) continue;
+			total += PIECE_VALUES[static_cast<int>(pieces[i].type)];
+			types[count++] = static_cast<int>(pieces[i].type);
+		}
+		std::sort(types, types + count, [](int a, int b) { return a > b; });
+		return total;
+	}
+
+	// Whether Black holds the stronger side, so the colors must be swapped to reach the table.
+	bool blackStronger(const Piece* pieces, int n) {
+		int white[Tablebase::MAX_PIECES];
+		int black[Tablebase::MAX_PIECES];
+		int whiteCount;
+		int blackCount;
+		const int w = strength(pieces, n, WHITE, white, whiteCount);
+		const int b = strength(pieces, n, BLACK, black, blackCount);
+		if (b != w) return b > w;
+		return std::lexicographical_compare(white, white + whiteCount, black, black + blackCount);
+	}
+
+	inline bool blackStronger(const Material& pieces) {
+		return blackStronger(pieces.data(), static_cast<int>(pieces.size()));
+	}
+
+	// Identifies a table by its pieces in table order, four bits each.
+	uint32_t materialKey(const Piece* canonical, int n) {
+		uint32_t key = 0;
+		for (int i = 0; i < n; i++) {
+			key = (key << 4) | (canonical[i].color == WHITE ? 0 : 8) | static_cast<uint32_t>(canonical[i].type);
+		}
+		return key | static_cast<uint32_t>(n) << 16;
+	}
+
+	std::string materialName(const Material& canonical) {
+		std::string name;
+		for (const Piece& p : canonical) {
+			name += "PNBRQK"[static_cast<int>(p.type)];
+		}
+		return name;
+	}
+
+	Material parseMaterial(const std::string& name) {
+		const size_t second = name.find('K', 1);
+		if (name.empty() || name[0] != 'K' || second == std::string::npos || name.find('K', second + 1) != std::string::npos) {
+			throw std::runtime_error("Invalid material: " + name);
+		}
+		if (name.size() > static_cast<size_t>(Tablebase::MAX_PIECES)) {
+			throw std::runtime_error("Too many pieces for a table: " + name);
+		}
+		Material pieces;
+		for (size_t i = 0; i < name.size(); i++) {
+			if (std::string("KQRBNP").find(name[i]) == std::string::npos) {
+				throw std::runtime_error("Invalid material: " + name);
+			}
+			const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(name[i])));
+			pieces.push_back(Piece(i < second ? WHITE : BLACK, Helper::charToSymbol(c)));
+		}
+		if (blackStronger(pieces)) {
+			for (Piece& p : pieces) p.color = Helper::swapColor(p.color);
+		}
+		std::stable_sort(pieces.begin(), pieces.end(), slotOrder);
+		return pieces;
+	}
+
+	inline size_t tableSize(int pieces) {
+		return static_cast<size_t>(2) << (6 * pieces);
+	}
+
+	// Size of a table file's data: the white king, always piece 0, is mirrored onto the a-d files.
+	inline size_t fileSize(int pieces) {
+		return tableSize(pieces) / 2;
+	}
+
+	inline size_t fileIndex(const int* sq, int n, Color turn) {
+		const int mirror = (sq[0] & 7) >= 4 ? 7 : 0;
+		const int king = sq[0] ^ mirror;
+		size_t index = (turn == WHITE ? 0 : 32) + (king >> 3) * 4 + (king & 7);
+		for (int i = 1; i < n; i++) {
+			index = (index << 6) | static_cast<size_t>(sq[i] ^ mirror);
+		}
+		return index;
+	}
+
+	// Where a lookup lands when a capture or a promotion changes the material: the child table, and for
+	// each piece of the parent the slot it takes in that table (-1 when it was captured).
+	struct Exit {
+		const std::vector<uint8_t>* table = nullptr;
+		int pieces = 0;
+		bool swap = false;
+		int slot[Tablebase::MAX_PIECES] = { -1, -1, -1, -1 };
+	};
+
+	class Generator;
+
+	// Builds one table. Pieces are tracked by square in table order; index bits are the side to move,
+	// then six bits per piece.
+	class Builder {
+	public:
+		Builder(Generator& generator, const Material& material) : _generator(generator), _material(material), _n(static_cast<int>(material.size())) {
+			for (int i = 0; i < _n; i++) {
+				if (_material[i].type == KING) _king[static_cast<int>(_material[i].color)] = i;
+			}
+		}
+
+		void build(std::vector<uint8_t>& values);
+
+	private:
+		Generator& _generator;
+		Material _material;
+		int _n;
+		int _king[2] = { 0, 0 };
+		std::map<int, Exit> _exits;
+
+		inline uint32_t _index(const int* sq, Color turn) const {
+			uint32_t index = turn == WHITE ? 0 : 1;
+			for (int i = 0; i < _n; i++) {
+				index = (index << 6) | static_cast<uint32_t>(sq[i]);
+			}
+			return index;
+		}
+
+		inline Color _decode(uint32_t index, int* sq) const {
+			for (int i = _n - 1; i >= 0; i--) {
+				sq[i] = index & 63;
+				index >>= 6;
+			}
+			return index ? BLACK : WHITE;
+		}
+
+		inline Bitboard _occupied(const int* sq, int skip = -1) const {
+			Bitboard occupied = 0;
+			for (int i = 0; i < _n; i++) {
+				if (i != skip) occupied |= Bitboards::square(sq[i]);
+			}
+			return occupied;
+		}
+
+		// Whether a square is attacked by a side, leaving out a captured piece.
+		bool _attacked(const int* sq, int target, Color by, int captured = -1) const {
+			const Bitboard occupied = _occupied(sq, captured);
+			for (int i = 0; i < _n; i++) {
+				if (i == captured || _material[i].color != by) continue;
+				const PieceSymbol type = _material[i].type;
+				const Bitboard attacks = type == PAWN ? Bitboards::pawnAttacks(by, sq[i]) : Bitboards::attacks(type, sq[i], occupied);
+				if (attacks & Bitboards::square(target)) return true;
+			}
+			return false;
+		}
+
+		inline bool _inCheck(const int* sq, Color side, int captured = -1) const {
+			return _attacked(sq, sq[_king[static_cast<int>(side)]], Helper::swapColor(side), captured);
+		}
+
+		bool _legal(const int* sq, Color turn) const {
+			Bitboard occupied = 0;
+			for (int i = 0; i < _n; i++) {
+				const Bitboard b = Bitboards::square(sq[i]);
+				if (occupied & b) return false;
+				occupied |= b;
+				if (_material[i].type == PAWN && ((sq[i] >> 3) == 0 || (sq[i] >> 3) == 7)) return false;
+			}
+			return !_inCheck(sq, Helper::swapColor(turn));
+		}
+
+		const Exit& _exit(int captured, int promoted, PieceSymbol promotion);
+
+		inline uint8_t _exitValue(const int* sq, Color turn, int mover, int to, int captured, PieceSymbol promotion) {
+			const Exit& e = _exit(captured, promotion != PieceSymbol::NONE ? mover : -1, promotion);
+			int child[Tablebase::MAX_PIECES];
+			for (int i = 0; i < _n; i++) {
+				if (e.slot[i] < 0) continue;
+				const int s = i == mover ? to : sq[i];
+				child[e.slot[i]] = e.swap ? s ^ 56 : s;
+			}
+			const Color childTurn = e.swap ? turn : Helper::swapColor(turn);
+			uint32_t index = childTurn == WHITE ? 0 : 1;
+			for (int i = 0; i < e.pieces; i++) {
+				index = (index << 6) | static_cast<uint32_t>(child[i]);
+			}
+			return (*e.table)[index];
+		}
+
+		// Calls f(piece, to, captured piece or -1, promotion) for each legal move.
+		template <typename F>
+		void _forEachMove(int* sq, Color turn, F f) const {
+			const Bitboard occupied = _occupied(sq);
+			for (int i = 0; i < _n; i++) {
+				if (_material[i].color != turn) continue;
+				const PieceSymbol type = _material[i].type;
+				const int from = sq[i];
+
+				Bitboard targets;
+				if (type == PAWN) {
+					const int step = turn == WHITE ? -8 : 8;
+					targets = 0;
+					if (!(occupied & Bitboards::square(from + step))) {
+						targets |= Bitboards::square(from + step);
+						const int startRow = turn == WHITE ? 6 : 1;
+						if ((from >> 3) == startRow && !(occupied & Bitboards::square(from + 2 * step))) {
+							targets |= Bitboards::square(from + 2 * step);
+						}
+					}
+					Bitboard enemies = 0;
+					for (int j = 0; j < _n; j++) {
+						if (_material[j].color != turn) enemies |= Bitboards::square(sq[j]);
+					}
+					targets |= Bitboards::pawnAttacks(turn, from) & enemies;
+				}
+				else {
+					targets = Bitboards::attacks(type, from, occupied);
+				}
+
+				while (targets) {
+					const int to = Bitboards::popLsb(targets);
+					int captured = -1;
+					for (int j = 0; j < _n; j++) {
+						if (sq[j] == to) captured = j;
+					}
+					if (captured >= 0 && _material[captured].color == turn) continue;
+					// Kings are never captured in a legal position.
+					if (captured >= 0 && _material[captured].type == KING) continue;
+
+					sq[i] = to;
+					const bool legal = !_inCheck(sq, turn, captured);
+					sq[i] = from;
+					if (!legal) continue;
+
+					if (type == PAWN && ((to >> 3) == 0 || (to >> 3) == 7)) {
+						for (PieceSymbol promotion : { QUEEN, ROOK, BISHOP, KNIGHT }) {
+							f(i, to, captured, promotion);
+						}
+					}
+					else {
+						f(i, to, captured, PieceSymbol::NONE);
+					}
+				}
+			}
+		}
+
+		// Calls f(piece, from) for each move by the side that is not to move which could have led here
+		// without a capture or a promotion, from a legal position.
+		template <typename F>
+		void _forEachUnmove(int* sq, Color turn, F f) const {
+			const Color mover = Helper::swapColor(turn);
+			const Bitboard occupied = _occupied(sq);
+			for (int i = 0; i < _n; i++) {
+				if (_material[i].color != mover) continue;
+				const PieceSymbol type = _material[i].type;
+				const int to = sq[i];
+
+				Bitboard origins;
+				if (type == PAWN) {
+					const int step = mover == WHITE ? 8 : -8;
+					origins = 0;
+					const int back = to + step;
+					const int backRow = back >> 3;
+					if (backRow >= 1 && backRow <= 6 && !(occupied & Bitboards::square(back))) {
+						origins |= Bitboards::square(back);
+						const int doubleRow = mover == WHITE ? 4 : 3;
+						if ((to >> 3) == doubleRow && !(occupied & Bitboards::square(back + step))) {
+							origins |= Bitboards::square(back + step);
+						}
+					}
+				}
+				else {
+					origins = Bitboards::attacks(type, to, occupied) & ~occupied;
+				}
+
+				while (origins) {
+					const int from = Bitboards::popLsb(origins);
+					sq[i] = from;
+					// The side to move now must not have been left in check before the move.
+					const bool legal = !_inCheck(sq, turn);
+					sq[i] = to;
+					if (legal) f(i, from);
+				}
+			}
+		}
+	};
+
+	// Generated tables by material name, kept while they are needed for the exits of bigger ones.
+	class Generator {
+	public:
+		const std::vector<uint8_t>& table(const Material& material) {
+			const std::string name = materialName(material);
+			auto it = _tables.find(name);
+			if (it != _tables.end()) return it->second;
+
+			std::vector<uint8_t> values;
+			Builder(*this, material).build(values);
+			return _tables.emplace(name, std::move(values)).first->second;
+		}
+
+		const std::map<std::string, std::vector<uint8_t>>& tables() const {
+			return _tables;
+		}
+
+	private:
+		std::map<std::string, std::vector<uint8_t>> _tables;
+	};
+
+	const Exit& Builder::_exit(int captured, int promoted, PieceSymbol promotion) {
+		const int key = (captured + 1) * 64 + (promoted + 1) * 8 + static_cast<int>(promotion) + 1;
+		auto it = _exits.find(key);
+		if (it != _exits.end()) return it->second;
+
+		Material child;
+		std::vector<int> from;
+		for (int i = 0; i < _n; i++) {
+			if (i == captured) continue;
+			child.push_back(i == promoted ? Piece(_material[i].color, promotion) : _material[i]);
+			from.push_back(i);
+		}
+
+		Exit e;
+		e.swap = blackStronger(child);
+		if (e.swap) {
+			for (Piece& p : child) p.color = Helper::swapColor(p.color);
+		}
+		std::vector<int> order(child.size());
+		for (size_t i = 0; i < order.size(); i++) order[i] = static_cast<int>(i);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return slotOrder(child[a], child[b]); });
+
+		Material canonical;
+		for (size_t slot = 0; slot < order.size(); slot++) {
+			canonical.push_back(child[order[slot]]);
+			e.slot[from[order[slot]]] = static_cast<int>(slot);
+		}
+		e.pieces = static_cast<int>(canonical.size());
+		e.table = &_generator.table(canonical);
+		return _exits.emplace(key, e).first->second;
+	}
+
+	void Builder::build(std::vector<uint8_t>& values) {
+		const size_t size = tableSize(_n);
+		values.assign(size, UNDECIDED);
+		// Moves still to be refuted before a position is lost, and the longest loss through an exit,
+		// or UNDECIDED when an exit draws (the position cannot be lost).
+		std::vector<uint8_t> remaining(size, 0);
+		std::vector<uint8_t> exitLoss(size, 0);
+		int longest = 0;
+		int sq[Tablebase::MAX_PIECES];
+
+		// Exits, mates and stalemates are known from the smaller tables.
+		for (uint32_t index = 0; index < size; index++) {
+			const Color turn = _decode(index, sq);
+			if (!_legal(sq, turn)) continue;
+
+			int moves = 0;
+			int internal = 0;
+			int bestWin = UNDECIDED;
+			int worstLoss = 0;
+			bool drawExit = false;
+			_forEachMove(sq, turn, [&](int mover, int to, int captured, PieceSymbol promotion) {
+				moves++;
+				if (captured < 0 && promotion == PieceSymbol::NONE) {
+					internal++;
+					return;
+				}
+				const uint8_t v = _exitValue(sq, turn, mover, to, captured, promotion);
+				if (v == UNDECIDED) drawExit = true;
+				else if (v % 2 == 0) bestWin = std::min(bestWin, v + 1);
+				else worstLoss = std::max(worstLoss, static_cast<int>(v));
+			});
+
+			if (moves == 0) {
+				if (_inCheck(sq, turn)) values[index] = 0;
+				continue;
+			}
+			remaining[index] = static_cast<uint8_t>(internal);
+			exitLoss[index] = drawExit ? UNDECIDED : static_cast<uint8_t>(worstLoss);
+			if (bestWin != UNDECIDED) {
+				values[index] = static_cast<uint8_t>(bestWin);
+			}
+			else if (internal == 0 && !drawExit) {
+				values[index] = static_cast<uint8_t>(worstLoss + 1);
+			}
+			if (values[index] != UNDECIDED) longest = std::max(longest, static_cast<int>(values[index]));
+		}
+
+		// Retrograde passes: the positions decided at distance d decide their predecessors. A position is
+		// won one ply after a lost successor, and lost once every move leads to a win for the opponent.
+		for (int d = 0; d <= std::min(longest, MAX_DISTANCE - 1); d++) {
+			for (uint32_t index = 0; index < size; index++) {
+				if (values[index] != d) continue;
+				const Color turn = _decode(index, sq);
+
+				_forEachUnmove(sq, turn, [&](int piece, int from) {
+					const int to = sq[piece];
+					sq[piece] = from;
+					const uint32_t parent = _index(sq, Helper::swapColor(turn));
+					sq[piece] = to;
+
+					uint8_t& v = values[parent];
+					if (d % 2 == 0) {
+						if (v == UNDECIDED || (v % 2 == 1 && v > d + 1)) {
+							v = static_cast<uint8_t>(d + 1);
+							longest = std::max(longest, d + 1);
+						}
+					}
+					else if (v == UNDECIDED && --remaining[parent] == 0 && exitLoss[parent] != UNDECIDED) {
+						v = static_cast<uint8_t>(std::max(d, static_cast<int>(exitLoss[parent])) + 1);
+						longest = std::max(longest, static_cast<int>(v));
+					}
+				});
+			}
+		}
+	}
+
+	void writeTable(const std::string& path, const std::string& name, const std::vector<uint8_t>& values) {
+		const int n = static_cast<int>(name.size());
+		std::vector<uint8_t> data(fileSize(n));
+		int sq[Tablebase::MAX_PIECES];
+		for (uint32_t index = 0; index < values.size(); index++) {
+			uint32_t rest = index;
+			for (int i = n - 1; i >= 0; i--) {
+				sq[i] = rest & 63;
+				rest >>= 6;
+			}
+			if ((sq[0] & 7) >= 4) continue;
+			data[fileIndex(sq, n, rest ? BLACK : WHITE)] = values[index];
+		}
+
+		TableHeader header = {};
+		std::memcpy(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+		header.version = TABLE_VERSION;
+		header.pieces = static_cast<uint32_t>(n);
+		std::memcpy(header.material, name.data(), name.size());
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			throw std::runtime_error("Cannot write " + path);
+		}
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	}
+}
+
+class Tablebase::Impl {
+public:
+	struct Table {
+		std::unique_ptr<MappedFile> file;
+		const uint8_t* data = nullptr;
+	};
+
+	std::map<uint32_t, Table> tables;
+
+	std::optional<TablebaseResult> probe(const Chess::chrImpl* impl) const;
+};
+
+std::optional<TablebaseResult> Tablebase::Impl::probe(const Chess::chrImpl* impl) const {
+	if (impl->_castlings) return std::nullopt;
+	const Bitboard occupied = impl->_occupied();
+	const int n = Bitboards::popCount(occupied);
+	if (n > MAX_PIECES) return std::nullopt;
+
+	Piece pieces[MAX_PIECES];
+	int sq[MAX_PIECES];
+	Bitboard b = occupied;
+	for (int i = 0; i < n; i++) {
+		sq[i] = Bitboards::popLsb(b);
+		pieces[i] = impl->_board[sq[i]];
+	}
+
+	// The table holds the stronger side as White; otherwise the board is turned around.
+	Color turn = impl->_turn;
+	if (blackStronger(pieces, n)) {
+		for (int i = 0; i < n; i++) {
+			pieces[i].color = Helper::swapColor(pieces[i].color);
+			sq[i] ^= 56;
+		}
+		turn = Helper::swapColor(turn);
+	}
+	// Insertion sort into table order, carrying the squares along.
+	for (int i = 1; i < n; i++) {
+		for (int j = i; j > 0 && slotOrder(pieces[j], pieces[j - 1]); j--) {
+			std::swap(pieces[j], pieces[j - 1]);
+			std::swap(sq[j], sq[j - 1]);
+		}
+	}
+	const auto it = tables.find(materialKey(pieces, n));
+	if (it == tables.end()) return std::nullopt;
+
+	const uint8_t v = it->second.data[fileIndex(sq, n, turn)];
+	TablebaseResult result;
+	if (v != UNDECIDED) {
+		result.wdl = v % 2 == 1 ? 1 : -1;
+		result.dtm = v;
+	}
+	return result;
+}
+
+Tablebase::Tablebase(const std::string& directory) : _impl(new Impl()) {
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+		if (entry.path().extension() != TABLE_EXTENSION) continue;
+
+		Impl::Table table;
+		table.file.reset(new MappedFile(entry.path().string()));
+		TableHeader header;
+		if (table.file->size() < sizeof(header)) continue;
+		std::memcpy(&header, table.file->data(), sizeof(header));
+		if (std::memcmp(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 ||
+			header.version != TABLE_VERSION ||
+			header.pieces < 2 || header.pieces > static_cast<uint32_t>(MAX_PIECES) ||
+			table.file->size() != sizeof(header) + fileSize(static_cast<int>(header.pieces))) {
+			continue;
+		}
+		table.data = reinterpret_cast<const uint8_t*>(table.file->data() + sizeof(header));
+		const Material material = parseMaterial(std::string(header.material, header.pieces));
+		_impl->tables[materialKey(material.data(), static_cast<int>(material.size()))] = std::move(table);
+	}
+}
+
+Tablebase::~Tablebase() {
+	delete _impl;
+}
+
+size_t Tablebase::size() const {
+	return _impl->tables.size();
+}
+
+std::optional<TablebaseResult> Tablebase::probe(const Chess& game) const {
+	const Chess::chrImpl* impl = game.chImpl;
+	const Color us = impl->_turn;
+	const bool enPassant = impl->_epSquare != EMPTY &&
+		(Bitboards::pawnAttacks(Helper::swapColor(us), impl->_epSquare) & impl->_piecesOf(us, PAWN));
+	if (!enPassant) {
+		return _impl->probe(impl);
+	}
+
+	// The tables have no en passant rights, so the moves are tried one by one.
+	Chess local(game);
+	Chess::chrImpl* position = local.chImpl;
+	const MoveList moves = position->_moves(true);
+	if (moves.empty()) {
+		return _impl->probe(impl);
+	}
+	std::optional<TablebaseResult> best;
+	for (const auto& m : moves) {
+		position->_makeMove(m);
+		const std::optional<TablebaseResult> child = probe(local);
+		position->_undoMove();
+		if (!child) return std::nullopt;
+
+		TablebaseResult r;
+		r.wdl = -child->wdl;
+		r.dtm = child->wdl == 0 ? 0 : child->dtm + 1;
+		const bool better = !best ||
+			r.wdl > best->wdl ||
+			(r.wdl == best->wdl && r.wdl > 0 && r.dtm < best->dtm) ||
+			(r.wdl == best->wdl && r.wdl < 0 && r.dtm > best->dtm);
+		if (better) best = r;
+	}
+	return best;
+}
+
+size_t Tablebase::generate(const std::string& material, const std::string& directory) {
+	Bitboards::init();
+	const Material pieces = parseMaterial(material);
+
+	Generator generator;
+	generator.table(pieces);
+	for (const auto& table : generator.tables()) {
+		const std::filesystem::path path = std::filesystem::path(directory) / (table.first + TABLE_EXTENSION);
+		writeTable(path.string(), table.first, table.second);
+	}
+	return generator.tables().size();
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include "../include/libtypes"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+using namespace ChessCpp;
+
+// Search results keyed by position hash, in 64-byte buckets of four entries so a probe touches one cache line.
+// Lock-free in the same way as PerftTable: each entry stores its key XORed with its data, so an entry torn
+// by two threads writing at once fails the check and reads as a miss.
+class TranspositionTable {
+public:
+    enum Bound : uint8_t {
+        NONE = 0,
+        UPPER = 1,      // The score is at most this (no move reached alpha).
+        LOWER = 2,      // The score is at least this (a move reached beta).
+        EXACT = 3
+    };
+
+    struct Hit {
+        PackedMove move;
+        int score = 0;
+        int depth = 0;
+        Bound bound = NONE;
+    };
+
+    explicit TranspositionTable(size_t megabytes) {
+        resize(megabytes);
+    }
+
+    // Reallocates the table, which empties it. Not safe while a search is using it.
+    void resize(size_t megabytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024) {
+            count *= 2;
+        }
+        _buckets.reset(new Bucket[count]);
+        _mask = count - 1;
+        _age = 0;
+    }
+
+    // Not safe while a search is using the table.
+    void clear() {
+        for (size_t i = 0; i <= _mask; i++) {
+            for (Entry& e : _buckets[i].entries) {
+                e.check.store(0, std::memory_order_relaxed);
+                e.data.store(0, std::memory_order_relaxed);
+            }
+        }
+        _age = 0;
+    }
+
+    // Starts a new generation; entries from earlier searches are replaced first.
+    inline void newSearch() {
+        _age = (_age + 1) & AGE_MASK;
+    }
+
+    size_t megabytes() const {
+        return (_mask + 1) * sizeof(Bucket) / (1024 * 1024);
+    }
+
+    inline bool probe(uint64_t key, Hit& hit) const {
+        const Bucket& b = _buckets[key & _mask];
+        for (const Entry& e : b.entries) {
+            const uint64_t data = e.data.load(std::memory_order_relaxed);
+            if ((e.check.load(std::memory_order_relaxed) ^ data) == key && data != 0) {
+                hit.move = PackedMove::fromRaw(static_cast<uint16_t>(data));
+                hit.score = static_cast<int16_t>(data >> SCORE_SHIFT);
+                hit.depth = static_cast<int>((data >> DEPTH_SHIFT) & 0xFF);
+                hit.bound = static_cast<Bound>((data >> BOUND_SHIFT) & 3);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // An entry for the same position is overwritten unless it holds a deeper result of this search.
+    // Otherwise the least valuable entry goes: shallow results, and results of older searches.
+    inline void store(uint64_t key, PackedMove move, int score, int depth, Bound bound) {
+        Bucket& b = _buckets[key & _mask];
+        Entry* replace = &b.entries[0];
+        int worst = INT32_MAX;
+        for (Entry& e : b.entries) {
+            const uint64_t data = e.data.load(std::memory_order_relaxed);
+            if (data == 0) {
+                replace = &e;
+                break;
+            }
+            if ((e.check.load(std::memory_order_relaxed) ^ data) == key) {
+                const bool deeperNow = _entryAge(data) == _age && _entryDepth(data) > depth + 2 && bound != EXACT;
+                if (deeperNow) return;
+                // Keep the old best move when this result has none.
+                if (!move) move = PackedMove::fromRaw(static_cast<uint16_t>(data));
+                replace = &e;
+                break;
+            }
+            const int value = _entryDepth(data) - 8 * ((_age - _entryAge(data)) & AGE_MASK);
+            if (value < worst) {
+                worst = value;
+                replace = &e;
+            }
+        }
+
+        const uint64_t data =
+            static_cast<uint64_t>(move.raw()) |
+            (static_cast<uint64_t>(static_cast<uint16_t>(score)) << SCORE_SHIFT) |
+            (static_cast<uint64_t>(depth & 0xFF) << DEPTH_SHIFT) |
+            (static_cast<uint64_t>(bound) << BOUND_SHIFT) |
+            (static_cast<uint64_t>(_age) << AGE_SHIFT);
+        replace->check.store(key ^ data, std::memory_order_relaxed);
+        replace->data.store(data, std::memory_order_relaxed);
+    }
+
+    // Permille of a sample of entries written by the current search, as UCI reports it.
+    int hashfull() const {
+        const size_t buckets = std::min<size_t>(250, _mask + 1);
+        size_t used = 0;
+        for (size_t i = 0; i < buckets; i++) {
+            for (const Entry& e : _buckets[i].entries) {
+                const uint64_t data = e.data.load(std::memory_order_relaxed);
+                if (data != 0 && _entryAge(data) == _age) used++;
+            }
+        }
+        return static_cast<int>(used * 1000 / (buckets * ENTRIES));
+    }
+
+private:
+    // Data word: move (bits 0-15), score (16-31), depth (32-39), bound (40-41), age (42-47).
+    // A stored bound is never NONE, so an empty entry is the only one with data 0.
+    static const int SCORE_SHIFT = 16;
+    static const int DEPTH_SHIFT = 32;
+    static const int BOUND_SHIFT = 40;
+    static const int AGE_SHIFT = 42;
+    static const int AGE_MASK = 0x3F;
+    static const int ENTRIES = 4;
+
+    struct Entry {
+        std::atomic<uint64_t> check{ 0 };
+        std::atomic<uint64_t> data{ 0 };
+    };
+
+    struct alignas(64) Bucket {
+        Entry entries[ENTRIES];
+    };
+
+    static inline int _entryDepth(uint64_t data) {
+        return static_cast<int>((data >> DEPTH_SHIFT) & 0xFF);
+    }
+
+    static inline int _entryAge(uint64_t data) {
+        return static_cast<int>((data >> AGE_SHIFT) & AGE_MASK);
+    }
+
+    std::unique_ptr<Bucket[]> _buckets;
+    size_t _mask = 0;
+    int _age = 0;
+};
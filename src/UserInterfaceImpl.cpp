@@ -1,4 +1,8 @@
 #include "InternalImpl.h"
+#include "../include/pgnreader"
+#include <algorithm>
+#include <atomic>
+#include <thread>
 using namespace ChessCpp;
 // Front-end implementations for the exposed user interface
 
@@ -17,48 +21,42 @@ std::string Chess::pgn(char newline, int maxWidth) {
 	if (headerExists && chImpl->_history.size() != 0) {
 		result.push_back(std::string(1, static_cast<char>(newline)));
 	}
-	const auto appendComment = [&](std::string moveString) -> std::string {
-		if (chImpl->_comments.count(fen()) == 0) return moveString;
-		const std::string comment = chImpl->_comments[fen()];
-		if (comment != "") {
-			const std::string delimiter = moveString.size() > 0 ? " " : "";
-			moveString += delimiter + "{" + comment + "}";
-		}
-		return moveString;
+	const auto appendComment = [&](std::string moveString, const std::string& fen) -> std::string {
+		const auto comment = chImpl->_comments.find(fen);
+		if (comment == chImpl->_comments.end() || comment->second.empty()) return moveString;
+		const std::string delimiter = moveString.size() > 0 ? " " : "";
+		return moveString + delimiter + "{" + comment->second + "}";
 		};
-	std::vector<std::optional<InternalMove>> reservedHistory;
-	while (chImpl->_history.size() > 0) {
-		reservedHistory.push_back(chImpl->_undoMove());
-	}
+
+	// Every move's SAN and the FEN before it are cached, so the game is written without replaying it.
+	chImpl->_cacheHistory();
+	const std::string currentFen = fen();
 
 	std::vector<std::string> moves;
 	std::string moveString = "";
 
-	if (reservedHistory.size() == 0) {
-		moves.push_back(appendComment(""));
+	if (chImpl->_history.empty()) {
+		moves.push_back(appendComment("", currentFen));
 	}
-	while (reservedHistory.size() > 0) {
-		moveString = appendComment(moveString);
-		std::optional<InternalMove> m = reservedHistory.back();
-		reservedHistory.pop_back();
+	for (size_t ply = 0; ply < chImpl->_history.size(); ply++) {
+		const History& h = chImpl->_history[ply];
+		const std::string& san = chImpl->_historyText[ply].san;
+		moveString = appendComment(moveString, chImpl->_historyText[ply].fen);
 
-		if (!m) break;
-
-		if (chImpl->_history.size() == 0 && m.value().color == Color::b) {
-			const std::string prefix = std::to_string(chImpl->_moveNumber) + ". ...";
+		if (ply == 0 && h.turn == Color::b) {
+			const std::string prefix = std::to_string(h.moveNumber) + ". ...";
 			moveString = !moveString.empty() ? moveString + " " + prefix : prefix;
 		}
-		else if (m.value().color == Color::w) {
+		else if (h.turn == Color::w) {
 			if (!moveString.empty()) {
 				moves.push_back(moveString);
 			}
-			moveString = std::to_string(chImpl->_moveNumber) + ".";
+			moveString = std::to_string(h.moveNumber) + ".";
 		}
-		moveString = moveString + " " + chImpl->_moveToSan(m.value(), chImpl->_moves(true));
-		chImpl->_makeMove(m.value());
+		moveString = moveString + " " + san;
 	}
 	if (!moveString.empty()) {
-		moves.push_back(appendComment(moveString));
+		moves.push_back(appendComment(moveString, currentFen));
 	}
 	if (chImpl->_header.count("Result") > 0) {
 		moves.push_back(chImpl->_header.at("Result"));
@@ -123,202 +121,226 @@ std::string Chess::pgn(char newline, int maxWidth) {
 }
 
 std::vector<PieceSymbol> Chess::getAttackingPieces(Color c, Square sq) {
-	return chImpl->_getAttackingPiece(c, Ox88.at((int)(sq)));
+	return chImpl->_getAttackingPiece(c, static_cast<int>(sq));
 }
 
-void Chess::loadPgn(std::string pgn, bool strict, std::string newlineChar) {
-	auto mask = [&](std::string str) -> std::string {
-		return std::regex_replace(str, std::regex(R"(\\)"), R"(\)");
-		};
-	auto parsePgnHeader = [&](std::string header) -> std::map<std::string, std::string> {
-		std::map<std::string, std::string> headerObj = {};
-		std::vector<std::string> headers = Helper::splitWithRegex(header, newlineChar);
-		std::string key = "";
-		std::string value = "";
-
-		for (int i = 0; i < static_cast<int>(headers.size()); i++) {
-			const std::regex reg = std::regex(R"(^\s*\[\s*([A-Za-z]+)\s*\"(.*)\"\s*\]\s*$)");
-			key = std::regex_replace(headers[i], reg, "$1");
-			value = std::regex_replace(headers[i], reg, "$2");
-			if (Helper::trim(key).size() > 0) {
-				headerObj.at(key) = value;
-			}
-		}
-		return headerObj;
-		};
-	pgn = Helper::trim(pgn);
-	std::string hdrRg(
-		R"(^(\[((?:)" +
-		mask(newlineChar) +
-		R"()|.)*\]))" +
-		R"(((?:\s*)" +
-		mask(newlineChar) +
-		R"(){2}|(?:\s*)" +
-		mask(newlineChar) +
-		")*$)"
-	);
-	std::regex headerRegex(hdrRg);
-	std::smatch matches;
-	std::string headerString = std::regex_search(pgn, matches, headerRegex) ? (matches.size() >= 2 ? std::string(matches[1]) : "") : "";
+void Chess::loadPgn(std::string pgn, bool strict, std::string /* newlineChr */) {
+	std::istringstream in(pgn);
+	PgnReader reader(in);
+	PgnGame game;
+
+	if (!reader.next(game)) {
+		reset();
+		chImpl->_header = {};
+		return;
+	}
+	if (!game.error.empty()) {
+		throw std::runtime_error("Invalid PGN: " + game.error);
+	}
+	loadPgn(game, strict);
+}
 
+void Chess::loadPgn(const PgnGame& game, bool strict) {
 	reset();
+	chImpl->_header = {};
 
-	std::map<std::string, std::string> headers = parsePgnHeader(headerString);
 	std::string pfen = "";
-
-	for (const auto& val : headers) {
+	for (const auto& h : game.headers) {
 		std::string lowerStr;
-		for (char c : val.first) {
-			lowerStr += std::tolower(c);
+		for (char c : h.first) {
+			lowerStr += static_cast<char>(std::tolower(c));
 		}
 		if (lowerStr == "fen") {
-			pfen = headers.at(val.first);
+			pfen = h.second;
 		}
-		header({ val.first, headers.at(val.first) });
+		header({ h.first, h.second });
 	}
 
-	if (!strict) {
-		if (!pfen.empty()) {
-			load(pfen, false, true);
+	if (strict) {
+		const std::optional<std::string> setUp = game.header("SetUp");
+		if (setUp && setUp.value() == "1" && !game.header("FEN")) {
+			throw std::runtime_error("Invalid PGN: FEN tag must be supplied with SetUp tag.");
 		}
+		pfen = game.header("FEN").value_or("");
 	}
-	else {
-		if (headers.at("SetUp") == "1") {
-			if (!(headers.count("FEN") > 0)) {
-				throw std::runtime_error("Invalid PGN: FEN tag must be supplied with SetUp tag.");
-			}
+	if (!pfen.empty()) {
+		load(pfen, false, true);
+	}
+
+	for (const auto& san : game.moves) {
+		const PackedMove m = chImpl->_moveFromSan(san, strict);
+		if (!m) {
+			throw std::runtime_error("Error move in PGN: " + san);
 		}
-		load(headers.at("FEN"), false, true);
+		chImpl->_makeMove(m);
 	}
-	auto toHex = [](std::string s) -> std::string {
-		std::stringstream hexStream;
-		auto encodeURIComponent = [](char c) {
-			std::string result;
 
-			if ((c & 0x80) == 0) {
-				// If the character is a single byte (ASCII), just add it
-				result += c;
-			}
-			else {
-				// Otherwise, handle multi-byte characters (simplified version)
-				result += "%" + std::to_string(static_cast<int>(c));
-			}
+	if (!game.result.empty() && !chImpl->_header.empty() && chImpl->_header.count("Result") == 0) {
+		header({ "Result", game.result });
+	}
+}
 
-			return result;
-			};
-		for (char c : s) {
-			if (static_cast<unsigned char>(c) < 128) {
-				// For characters with code < 128, convert to hexadecimal directly
-				hexStream << std::hex << std::setw(2) << std::setfill('0')
-					<< static_cast<int>(c);
-			}
-			else {
-				// For characters with code >= 128, encode them and convert to hex
-				std::string encoded = "%" + encodeURIComponent(c);
-				for (char encodedChar : encoded) {
-					hexStream << std::hex << std::setw(2) << std::setfill('0')
-						<< static_cast<int>(encodedChar);
-				}
-			}
-		}
+namespace {
+	const unsigned char BINARY_VERSION = 1;
 
-		return hexStream.str();
-		};
-	auto fromHex = [](std::string s) -> std::string {
-		std::stringstream hexStream;
+	// A ply is one byte: the moving piece, counted among the mover's pieces from a8, in the high four bits,
+	// and the move's index among that piece's legal moves in the low four. An index of 15 or more stores 15
+	// and the rest in a second byte. A side with more than 16 pieces, possible only in an unvalidated setup,
+	// takes a byte for each.
+	const int MAX_PACKED_PIECES = 16;
+	const int INDEX_ESCAPE = 15;
 
-		for (char c : s) {
-			hexStream << "%" << std::setw(2) << std::setfill('0') << std::hex << (int)c;
+	// Lengths and counts are stored seven bits to a byte, low bits first, so small ones take one byte.
+	void writeVarint(std::string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out += static_cast<char>((value & 0x7F) | 0x80);
+			value >>= 7;
 		}
+		out += static_cast<char>(value);
+	}
 
-		return hexStream.str();
-		};
-	auto encodeComment = [&](std::string s) -> std::string {
-		std::string modified = s;
-		std::replace(modified.begin(), modified.end(), '\n', ' ');
+	void writeString(std::string& out, const std::string& s) {
+		writeVarint(out, s.size());
+		out += s;
+	}
 
-		if (modified.length() > 2) {
-			modified = modified.substr(1, modified.length() - 2);
-		}
+	class BinaryInput {
+	public:
+		BinaryInput(const char* data, size_t size) : _data(reinterpret_cast<const unsigned char*>(data)), _size(size) {}
 
-		return "{" + toHex(modified) + "}";
-		};
-	auto decodeComment = [&](std::string s) {
-		if (s.front() == '{' && s.back() == '}') {
-			return fromHex(s.substr(1, s.length() - 2));
+		size_t position() const { return _position; }
+
+		unsigned char byte() {
+			if (_position >= _size) {
+				throw std::runtime_error("Invalid binary game: data ends early");
+			}
+			return _data[_position++];
 		}
-		return std::string("");
-		};
-	std::string ms = [&]() -> std::string {
-		std::string processed = Helper::replaceSubstring(pgn, headerString, "");
-		std::regex pattern(std::string(R"(({[^}]*})+?|;([^\r?\n]*))"), std::regex_constants::basic); // FIX THIS
 
-		std::string result;
-		std::smatch match;
-		std::string::const_iterator searchStart(processed.cbegin());
+		uint64_t varint() {
+			uint64_t value = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				const unsigned char b = byte();
+				value |= static_cast<uint64_t>(b & 0x7F) << shift;
+				if (!(b & 0x80)) return value;
+			}
+			throw std::runtime_error("Invalid binary game: bad length");
+		}
 
-		while (std::regex_search(searchStart, processed.cend(), match, pattern)) {
-			result += processed.substr(0, match.position()); // Add text before match
-			result += "";                                    // Replace match (empty string here)
-			searchStart = match.suffix().first;             // Move past the match
+		std::string text() {
+			const uint64_t length = varint();
+			if (length > _size - _position) {
+				throw std::runtime_error("Invalid binary game: data ends early");
+			}
+			std::string s(reinterpret_cast<const char*>(_data + _position), static_cast<size_t>(length));
+			_position += static_cast<size_t>(length);
+			return s;
 		}
-		result += std::string(searchStart, processed.cend()); // Append the rest
 
-		return result;
-		}();
-	std::regex ravRegex(R"((\([^()]+\))+?)");
+	private:
+		const unsigned char* _data;
+		size_t _size;
+		size_t _position = 0;
+	};
+}
 
-	while (std::regex_search(ms, ravRegex)) {
-		ms = std::regex_replace(ms, ravRegex, "");
+std::string Chess::binary() {
+	// The moves are taken back on a copy to reach the starting position, then played again to encode them.
+	Chess local(*this);
+	std::vector<PackedMove> moves;
+	while (!local.chImpl->_history.empty()) {
+		moves.push_back(local.chImpl->_undoMove());
 	}
+	const std::string start = local.fen();
 
-	ms = std::regex_replace(ms, std::regex(R"(\d+\.(\.\.)?)"), "");
-
-	ms = std::regex_replace(ms, std::regex(R"(\.\.\.)"), "");
-
-	ms = std::regex_replace(ms, std::regex(R"($\d+)"), "");
+	std::string out;
+	out += static_cast<char>(BINARY_VERSION);
+	writeVarint(out, chImpl->_header.size());
+	for (const auto& h : chImpl->_header) {
+		writeString(out, h.first);
+		writeString(out, h.second);
+	}
+	writeString(out, start == DEFAULT_POSITION ? std::string() : start);
 
-	auto moves = Helper::splitWithRegex(Helper::trim(ms), R"(\s+)");
+	writeVarint(out, moves.size());
+	for (auto it = moves.rbegin(); it != moves.rend(); ++it) {
+		const Bitboard own = local.chImpl->_colors[static_cast<int>(local.chImpl->_turn)];
+		const int piece = Bitboards::popCount(own & (Bitboards::square(it->from()) - 1));
+		MoveList legal;
+		local.chImpl->_movesFrom(legal, it->from());
+		const int index = static_cast<int>(std::find(legal.begin(), legal.end(), *it) - legal.begin());
 
-	std::string result = "";
+		if (Bitboards::popCount(own) > MAX_PACKED_PIECES) {
+			out += static_cast<char>(piece);
+			out += static_cast<char>(index);
+		}
+		else {
+			out += static_cast<char>((piece << 4) | std::min(index, INDEX_ESCAPE));
+			if (index >= INDEX_ESCAPE) out += static_cast<char>(index - INDEX_ESCAPE);
+		}
+		local.chImpl->_makeMove(*it);
+	}
+	return out;
+}
 
-	for (int halfMove = 0; halfMove < static_cast<int>(moves.size()); halfMove++) {
-		const auto comment = decodeComment(moves[halfMove]);
-		if (!comment.empty()) { chImpl->_comments.at(fen()) = comment; continue; }
+size_t Chess::loadBinary(const char* data, size_t size) {
+	BinaryInput in(data, size);
+	if (in.byte() != BINARY_VERSION) {
+		throw std::runtime_error("Invalid binary game: unknown version");
+	}
+	std::map<std::string, std::string> headers;
+	for (uint64_t n = in.varint(); n > 0; n--) {
+		std::string key = in.text();
+		headers[key] = in.text();
+	}
+	const std::string start = in.text();
 
-		const auto m = chImpl->_moveFromSan(moves[halfMove], strict);
+	// The start was written from a position the library held, which may have been set up without validation.
+	reset();
+	if (!start.empty()) {
+		load(start, true, true);
+	}
+	chImpl->_header = headers;
 
-		if (!m) {
-			if (std::find(TERMINATION_MARKERS.begin(), TERMINATION_MARKERS.end(), moves[halfMove]) != TERMINATION_MARKERS.end()) {
-				result = moves[halfMove];
-			}
-			else {
-				throw std::runtime_error("Error move in PGN: " + moves[halfMove]);
-			}
+	for (uint64_t n = in.varint(); n > 0; n--) {
+		Bitboard own = chImpl->_colors[static_cast<int>(chImpl->_turn)];
+		int piece;
+		int index;
+		if (Bitboards::popCount(own) > MAX_PACKED_PIECES) {
+			piece = in.byte();
+			index = in.byte();
 		}
 		else {
-			result = "";
-			chImpl->_makeMove(m.value());
-			chImpl->_incPositionCount(fen());
+			const unsigned char b = in.byte();
+			piece = b >> 4;
+			index = b & 0x0F;
+			if (index == INDEX_ESCAPE) index += in.byte();
+		}
+		if (piece >= Bitboards::popCount(own)) {
+			throw std::runtime_error("Invalid binary game: no piece " + std::to_string(piece) + " to move");
+		}
+		for (int i = 0; i < piece; i++) {
+			own &= own - 1;
 		}
-	}
 
-	if (!result.empty() && !chImpl->_header.empty() && chImpl->_header.count("Header") == 0) {
-		header({ "Result", result });
+		MoveList legal;
+		chImpl->_movesFrom(legal, Bitboards::lsb(own));
+		if (index >= static_cast<int>(legal.size())) {
+			throw std::runtime_error("Invalid binary game: move " + std::to_string(index) + " is not legal");
+		}
+		chImpl->_makeMove(legal[index]);
 	}
+	return in.position();
 }
 
 std::string Chess::ascii(bool isWhitePersp) {
 	std::string s = "   +---+---+---+---+---+---+---+---+\n";
 
-	int start = isWhitePersp ? 0 : 7;
-	int end = isWhitePersp ? 119 : 112;
-	int step = isWhitePersp ? 1 : -1;
-
-	for (int i = start; (isWhitePersp ? i <= end : i >= end); i += step) {
-		if (file(i) == 0) {
-			int rankIdx = isWhitePersp ? rank(i) : 7 - rank(i);
-			s += (" " + std::string(1, std::string("87654321")[rankIdx]) + " |");
+	for (int n = 0; n < 64; n++) {
+		// Black's perspective walks the board backwards, from h1 to a8.
+		const int i = isWhitePersp ? n : 63 - n;
+		if ((n & 7) == 0) {
+			s += (" " + std::string(1, std::string("87654321")[i >> 3]) + " |");
 		}
 
 		if (chImpl->_board[i]) {
@@ -334,10 +356,9 @@ std::string Chess::ascii(bool isWhitePersp) {
 			s += " . ";
 		}
 
-		if ((i + step) & 0x88) {
+		if ((n & 7) == 7) {
 			s += "|\n";
 			s += "   +---+---+---+---+---+---+---+---+\n";
-			i += (isWhitePersp ? 8 : -8);
 		}
 		else {
 			s += "|";
@@ -358,168 +379,58 @@ std::string Chess::ascii(bool isWhitePersp) {
 }
 
 std::string Chess::fen() {
-	int empty = 0;
-	std::string fen = "";
-
-	for (int i = 0; i <= 119; i++) {
-		if (chImpl->_board[i]) {
-			if (empty > 0) {
-				fen += std::to_string(empty);
-				empty = 0;
-			}
-			Color c = chImpl->_board[i].color;
-			PieceSymbol type = chImpl->_board[i].type;
-
-			fen += c == WHITE ? std::toupper(Helper::pieceToChar(type)) : std::tolower(Helper::pieceToChar(type));
-		}
-		else {
-			empty++;
-		}
-
-		if ((i + 1) & 0x88) {
-			if (empty > 0) {
-				fen += std::to_string(empty);
-			}
-			if (i != 119) {
-				fen += '/';
-			}
-
-			empty = 0;
-			i += 8;
-		}
-	}
+	char buffer[FEN_BUFFER_SIZE];
+	const size_t length = chImpl->_writeFen(buffer);
+	return std::string(buffer, length);
+}
 
-	std::string castling = "";
-	if (chImpl->_castlings & CASTLE_WK) {
-		castling += 'K';
-	}
-	if (chImpl->_castlings & CASTLE_WQ) {
-		castling += 'Q';
+size_t Chess::fen(char* buffer, size_t size) {
+	char fenBuffer[FEN_BUFFER_SIZE];
+	const size_t length = chImpl->_writeFen(fenBuffer);
+	if (size > 0) {
+		const size_t n = std::min(length, size - 1);
+		std::memcpy(buffer, fenBuffer, n);
+		buffer[n] = '\0';
 	}
-	if (chImpl->_castlings & CASTLE_BK) {
-		castling += 'k';
-	}
-	if (chImpl->_castlings & CASTLE_BQ) {
-		castling += 'q';
-	}
-
-	castling = castling.empty() ? "-" : castling;
-
-	std::string epSquare = "-";
-
-	if (chImpl->_epSquare != EMPTY) {
-		Square bigPawnSquare = static_cast<Square>(chImpl->_epSquare + (chImpl->_turn == WHITE ? 16 : -16));
-		std::vector<int> squares = { static_cast<int>(bigPawnSquare) + 1, static_cast<int>(bigPawnSquare) - 1 };
-		for (auto& sq : squares) {
-			if (sq & 0x88) {
-				continue;
-			}
-			Color ct = chImpl->_turn;
-			std::optional<Piece> p = chImpl->_board[sq];
-			if (
-				p &&
-				p.value().color == ct &&
-				p.value().type == PAWN
-				) {
-				chImpl->_makeMove({
-					ct,
-					sq,
-					chImpl->_epSquare,
-					PAWN,
-					PAWN,
-					PieceSymbol::NONE,
-					BITS_EP_CAPTURE
-					});
-				bool isLegal = !chImpl->_isKingAttacked(ct);
-				chImpl->_undoMove();
-
-				if (isLegal) {
-					epSquare = squareToString(algebraic(chImpl->_epSquare));
-					break;
-				}
-			}
-		}
-	}
-	std::vector<std::string> elements = { fen, std::string(chImpl->_turn == WHITE ? "w" : "b"), castling, epSquare, std::to_string(chImpl->_halfMoves), std::to_string(chImpl->_moveNumber) };
-	return Helper::join(elements, " ");
+	return length;
 }
 
 void Chess::load(std::string fen, bool skipValidation, bool preserveHeaders) {
-	std::vector<std::string> tokens = Helper::splitWithRegex(fen, "\\s+");
-	if (tokens.size() >= 2 && tokens.size() < 6) {
-		std::vector<char> adjustments = { '-', '-', '0', '1' };
-		int sliceLength = std::max(0, 6 - static_cast<int>(tokens.size()));
-		std::vector<std::string> slicedAdjustments;
-		std::transform(
-			adjustments.end() - sliceLength, adjustments.end(),
-			std::back_inserter(slicedAdjustments),
-			[](char c) { return std::string(1, c); }
-		);
-		std::vector<std::string> result = tokens;
-		result.insert(result.end(), slicedAdjustments.begin(), slicedAdjustments.end());
-		std::ostringstream oss;
-		for (size_t i = 0; i < result.size(); ++i) {
-			if (i > 0) oss << " ";
-			oss << result[i];
-		}
-		fen = oss.str();
+	ParsedFen parsed;
+	const char* error = parseFen(fen, parsed, true, !skipValidation);
+	if (error) {
+		throw std::runtime_error(error);
 	}
-	tokens = Helper::splitWithRegex(fen, R"(\s+)");
 
-	if (!skipValidation) {
-		std::pair<bool, std::string> result = validateFen(fen);
-		if (!result.first) {
-			throw std::runtime_error(result.second.c_str());
+	// A FEN missing its last fields is completed, and that completed form is what the headers record.
+	if (parsed.fields < 6) {
+		std::string padded;
+		for (const auto& token : Helper::split(fen, ' ')) {
+			if (token.empty()) continue;
+			padded += padded.empty() ? token : " " + token;
+		}
+		static const char* const DEFAULT_FIELDS[] = { "-", "-", "0", "1" };
+		for (int f = parsed.fields; f < 6; f++) {
+			padded += std::string(" ") + DEFAULT_FIELDS[f - 2];
 		}
+		fen = padded;
 	}
-	const std::string position = tokens[0];
-	int squ = 0;
 
 	clear(preserveHeaders);
 
-	for (int i = 0; i < static_cast<int>(position.size()); i++) {
-		const char p = static_cast<char>(position.at(i));
-
-		if (p == '/') {
-			squ += 8;
-		}
-		else if (std::isdigit(p)) {
-			squ += p - '0';
-		}
-		else {
-			const Color color = p < 'a' ? WHITE : BLACK;
-			try {
-				chImpl->_put(Helper::charToSymbol(std::tolower(p)), color, algebraic(squ));
-			}
-			catch (const std::exception& e) {
-				std::cout << e.what() << '\n';
-				throw std::exception();
-			}
-			squ++;
+	for (int sq = 0; sq < 64; sq++) {
+		const Piece& p = parsed.board[sq];
+		if (p.type != PieceSymbol::NONE) {
+			chImpl->_put(p.type, p.color, static_cast<Square>(sq));
 		}
 	}
-	chImpl->_turn = tokens[1][0] == 'w' ? WHITE : BLACK;
-
-	auto kingSideCastleWhite = std::find(tokens[2].begin(), tokens[2].end(), 'K');
-	auto queenSideCastleWhite = std::find(tokens[2].begin(), tokens[2].end(), 'Q');
-	auto kingSideCastleBlack = std::find(tokens[2].begin(), tokens[2].end(), 'k');
-	auto queenSideCastleBlack = std::find(tokens[2].begin(), tokens[2].end(), 'q');
-
-	if (kingSideCastleWhite != tokens[2].end())
-		chImpl->_castlings |= CASTLE_WK;
-	if (queenSideCastleWhite != tokens[2].end())
-		chImpl->_castlings |= CASTLE_WQ;
-	if (kingSideCastleBlack != tokens[2].end())
-		chImpl->_castlings |= CASTLE_BK;
-	if (queenSideCastleBlack != tokens[2].end())
-		chImpl->_castlings |= CASTLE_BQ;
-
-	chImpl->_epSquare = tokens[3] == "-" ? EMPTY : Ox88.at((int)(stringToSquare(tokens[3])));
-	chImpl->_halfMoves = std::stoi(tokens[4]);
-	chImpl->_moveNumber = std::stoi(tokens[5]);
+	chImpl->_turn = parsed.turn;
+	chImpl->_castlings = parsed.castling;
+	chImpl->_epSquare = parsed.epSquare;
+	chImpl->_halfMoves = parsed.halfMoves;
+	chImpl->_moveNumber = parsed.moveNumber;
 
 	chImpl->_updateSetup(fen);
-	chImpl->_incPositionCount(fen);
 }
 
 int Chess::moveNumber() {
@@ -552,50 +463,37 @@ bool Chess::isGameOver() {
 }
 
 std::vector<std::string> Chess::history_s() {
-	auto hs = history(false);
+	chImpl->_cacheHistory();
 	std::vector<std::string> result;
-
-	for (auto& m : hs) {
-		result.push_back(std::get<std::string>(m));
+	result.reserve(chImpl->_history.size());
+	for (size_t ply = 0; ply < chImpl->_history.size(); ply++) {
+		result.push_back(chImpl->_historyText[ply].san);
 	}
 	return result;
 }
 
 std::vector<Move> Chess::history_m() {
-	auto hs = history(true);
+	chImpl->_cacheHistory();
 	std::vector<Move> result;
-
-	for (auto& m : hs) {
-		result.push_back(std::get<Move>(m));
+	result.reserve(chImpl->_history.size());
+	for (size_t ply = 0; ply < chImpl->_history.size(); ply++) {
+		result.push_back(chImpl->_historyMove(ply));
 	}
 	return result;
 }
 
 std::vector<std::variant<std::string, Move>> Chess::history(bool verbose) {
-	std::vector<std::optional<InternalMove>> reservedHistory;
+	chImpl->_cacheHistory();
 	std::vector<std::variant<std::string, Move>> moveHistory;
-
-	while (chImpl->_history.size() > 0) {
-		reservedHistory.push_back(chImpl->_undoMove());
-	}
-
-	while (true) {
-		if (reservedHistory.empty()) return moveHistory;
-
-		auto m = reservedHistory.back();
-		reservedHistory.pop_back();
-
-		if (!m) break;
-
+	moveHistory.reserve(chImpl->_history.size());
+	for (size_t ply = 0; ply < chImpl->_history.size(); ply++) {
 		if (verbose) {
-			moveHistory.push_back(chImpl->_makePretty(m.value()));
+			moveHistory.push_back(chImpl->_historyMove(ply));
 		}
 		else {
-			moveHistory.push_back(chImpl->_moveToSan(m.value(), chImpl->_moves(true)));
+			moveHistory.push_back(chImpl->_historyText[ply].san);
 		}
-		chImpl->_makeMove(m.value());
 	}
-
 	return moveHistory;
 }
 
@@ -605,13 +503,10 @@ Color Chess::turn() {
 
 std::optional<Piece> Chess::remove(Square sq) {
 	Piece p = get(sq);
-	chImpl->_board[Ox88.at((int)(sq))] = Piece();
-	if (p && p.type == KING) {
-		chImpl->_kings[p.color] = EMPTY;
-	}
-	else if (!p) {
+	if (!p) {
 		return std::nullopt;
 	}
+	chImpl->_removePiece(static_cast<int>(sq));
 
 	chImpl->_updateCastlingRights();
 	chImpl->_updateEnPassantSquare();
@@ -621,13 +516,15 @@ std::optional<Piece> Chess::remove(Square sq) {
 }
 
 std::optional<Move> Chess::undo() {
-	std::optional<InternalMove> m = chImpl->_undoMove();
-	if (m) {
-		Move prettyMove = chImpl->_makePretty(m.value());
-		chImpl->_decPositionCount(prettyMove.after);
-		return prettyMove;
+	if (chImpl->_history.empty()) {
+		return std::nullopt;
 	}
-	return std::nullopt;
+	if (chImpl->_textCached(chImpl->_history.size() - 1)) {
+		Move m = chImpl->_historyMove(chImpl->_history.size() - 1);
+		chImpl->_undoMove();
+		return m;
+	}
+	return chImpl->_makePretty(chImpl->_unpack(chImpl->_undoMove()));
 }
 
 std::optional<std::string> Chess::squareColor(Square sq) {
@@ -639,50 +536,93 @@ std::optional<std::string> Chess::squareColor(Square sq) {
 }
 
 Piece Chess::get(Square sq) {
-	return chImpl->_board[static_cast<int>(sq)] ? chImpl->_board[static_cast<int>(sq)] : Piece();
+	if (!Helper::isValid8x8(sq)) {
+		return Piece();
+	}
+	return chImpl->_board[static_cast<int>(sq)];
 }
 
 Move Chess::makeMove(const std::variant<std::string, MoveOption>& moveArg, bool strict) {
-	std::optional<InternalMove> moveObj = std::nullopt;
-	if (std::holds_alternative<std::string>(moveArg)) {
-		moveObj = chImpl->_moveFromSan(std::get<std::string>(moveArg), strict);
-	}
-	else {
-		std::vector<InternalMove> moves = chImpl->_moves(true);
-		MoveOption o = std::get<MoveOption>(moveArg);
-		Move m = {
-			chImpl->_turn,
-			stringToSquare(o.from),
-			stringToSquare(o.to),
-			PieceSymbol::NONE,
-			PieceSymbol::NONE,
-			o.promotion ? PieceSymbol(Helper::charToSymbol(o.promotion.value()[0])) : PieceSymbol::NONE
-		};
-		for (int i = 0; i < static_cast<int>(moves.size()); i++) {
-			if (
-				m.from == algebraic(moves[i].from) &&
-				m.to == algebraic(moves[i].to) &&
-				(moves[i].promotion == PieceSymbol::NONE || m.promotion == moves[i].promotion)
-				) {
-				moveObj = moves[i];
-				break;
+	const MoveList legal = chImpl->_moves(true);
+	chImpl->_playMove(chImpl->_findMove(moveArg, legal, strict), legal);
+	return chImpl->_historyMove(chImpl->_history.size() - 1);
+}
+
+MoveRecord Chess::playMove(const std::variant<std::string, MoveOption>& moveArg, bool strict) {
+	const PackedMove m = chImpl->_findMove(moveArg, chImpl->_moves(true), strict);
+	const Piece& moving = chImpl->_board[m.from()];
+
+	MoveRecord record;
+	record.color = moving.color;
+	record.from = static_cast<Square>(m.from());
+	record.to = static_cast<Square>(m.to());
+	record.piece = moving.type;
+	record.captured = m.isEnPassant() ? PAWN : chImpl->_board[m.to()].type;
+	record.promotion = m.promotion();
+	record._kind = m.kind();
+	std::copy(chImpl->_pieces.begin(), chImpl->_pieces.end(), record._bitboards.begin());
+	std::copy(chImpl->_colors.begin(), chImpl->_colors.end(), record._bitboards.begin() + 6);
+	record._turn = chImpl->_turn;
+	record._castling = chImpl->_castlings;
+	record._epSquare = chImpl->_epSquare;
+	record._halfMoves = chImpl->_halfMoves;
+	record._moveNumber = chImpl->_moveNumber;
+
+	chImpl->_makeMove(m);
+	return record;
+}
+
+namespace {
+	const char* const EMPTY_BOARD = "8/8/8/8/8/8/8/8 w - - 0 1";
+}
+
+Chess MoveRecord::_position() const {
+	Chess position(EMPTY_BOARD, true);
+	Chess::chrImpl* impl = position.chImpl;
+	for (int type = 0; type < 6; type++) {
+		for (int color = 0; color < 2; color++) {
+			Bitboard pieces = _bitboards[type] & _bitboards[6 + color];
+			while (pieces) {
+				impl->_setPiece(Bitboards::popLsb(pieces), Piece(static_cast<Color>(color), static_cast<PieceSymbol>(type)));
 			}
 		}
 	}
+	impl->_turn = _turn;
+	impl->_castlings = _castling;
+	impl->_epSquare = _epSquare;
+	impl->_halfMoves = _halfMoves;
+	impl->_moveNumber = _moveNumber;
+	return position;
+}
 
-	if (!moveObj) {
-		if (std::holds_alternative<std::string>(moveArg))
-			throw std::runtime_error("Invalid move: " + std::get<std::string>(moveArg));
-		else if (std::holds_alternative<MoveOption>(moveArg))
-			throw std::runtime_error("Invalid move: from " + std::get<MoveOption>(moveArg).from + "to " + std::get<MoveOption>(moveArg).to);
-		throw std::runtime_error("Invalid move");
-	}
+std::string MoveRecord::san() const {
+	Chess position = _position();
+	const PackedMove m(static_cast<int>(from), static_cast<int>(to), _kind);
+	return position.chImpl->_moveToSan(m, position.chImpl->_moves(true));
+}
+
+std::string MoveRecord::lan() const {
+	return Helper::moveToLan(PackedMove(static_cast<int>(from), static_cast<int>(to), _kind));
+}
+
+std::string MoveRecord::flags() const {
+	return Helper::flagsToString(PackedMove(static_cast<int>(from), static_cast<int>(to), _kind).flags());
+}
+
+std::string MoveRecord::before() const {
+	return _position().fen();
+}
 
-	Move prettyMove = chImpl->_makePretty(moveObj.value());
+std::string MoveRecord::after() const {
+	Chess position = _position();
+	position.chImpl->_makeMove(PackedMove(static_cast<int>(from), static_cast<int>(to), _kind));
+	return position.fen();
+}
 
-	chImpl->_makeMove(moveObj.value());
-	chImpl->_incPositionCount(prettyMove.after);
-	return prettyMove;
+Move MoveRecord::toMove() const {
+	Chess position = _position();
+	const PackedMove m(static_cast<int>(from), static_cast<int>(to), _kind);
+	return position.chImpl->_makePretty(position.chImpl->_unpack(m));
 }
 
 Move Chess::makeMove(const Move& move) {
@@ -693,40 +633,104 @@ Move Chess::makeMove(const Move& move) {
 	}, false);
 }
 
-void classifyMoveFlags(const InternalMove& move, PerftStats& stats) {
-	int f = move.flags;
-
-	if (f & BITS_CAPTURE) ++stats.captures;
-	if (f & BITS_EP_CAPTURE) ++stats.enPassants;
-	if (f & BITS_PROMOTION) ++stats.promotions;
-	if (f & (BITS_KSIDE_CASTLE | BITS_QSIDE_CASTLE)) ++stats.castles;
+uint64_t Chess::perft(int depth) {
+	return chImpl->_perft(depth);
 }
 
-uint64_t Chess::perft(int depth) {
-	if (depth == 0) return 1;
-
-	const auto& moves = chImpl->_moves(false);
-	if (depth == 1) {
-		int count = 0;
-		const auto c = chImpl->_turn;
-		for (const auto& m : moves) {
-			chImpl->_makeMove(m);
-			if (!chImpl->_isKingAttacked(c))
-				++count;
-			chImpl->_undoMove();
+uint64_t Chess::perft(int depth, int threads, int splitDepth) {
+	if (threads <= 0) {
+		threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+	if (threads == 1 || depth < 2) {
+		return chImpl->_perft(depth);
+	}
+	splitDepth = std::clamp(splitDepth, 1, depth - 1);
+
+	std::vector<std::vector<PackedMove>> work;
+	std::vector<PackedMove> path;
+	chImpl->_splitPoints(splitDepth, path, work);
+
+	// Workers pull split points off a shared counter, each replaying them on its own copy of the game.
+	std::atomic<size_t> next{ 0 };
+	std::atomic<uint64_t> nodes{ 0 };
+	const auto worker = [&]() {
+		Chess local(*this);
+		uint64_t count = 0;
+		for (size_t i = next++; i < work.size(); i = next++) {
+			for (const auto& m : work[i]) {
+				local.chImpl->_makeMove(m);
+			}
+			count += local.chImpl->_perft(depth - splitDepth);
+			for (size_t j = 0; j < work[i].size(); j++) {
+				local.chImpl->_undoMove();
+			}
 		}
-		return count;
+		nodes += count;
+	};
+
+	std::vector<std::thread> pool;
+	const int poolSize = std::min(threads, static_cast<int>(work.size()));
+	for (int t = 0; t < poolSize; t++) {
+		pool.emplace_back(worker);
+	}
+	for (auto& t : pool) {
+		t.join();
 	}
+	return nodes;
+}
+
+SearchResult Chess::search(const SearchLimits& limits) {
+	return chImpl->_search(limits);
+}
+
+int Chess::evaluate() {
+	return chImpl->_evaluate();
+}
 
-	uint64_t nodes = 0;
-	const auto c = chImpl->_turn;
-	for (const auto& m : moves) {
+void Chess::setHashSize(size_t megabytes) {
+	chImpl->_hashSize = megabytes;
+	if (megabytes == 0) {
+		chImpl->_hashTable = nullptr;
+	}
+	else if (chImpl->_hashTable) {
+		chImpl->_hashTable->resize(megabytes);
+	}
+}
+
+void Chess::clearHash() {
+	if (chImpl->_hashTable) {
+		chImpl->_hashTable->clear();
+	}
+}
+
+int Chess::hashfull() {
+	return chImpl->_hashTable ? chImpl->_hashTable->hashfull() : 0;
+}
+
+PerftStats Chess::perftStats(int depth) {
+	PerftStats stats;
+	if (depth <= 0) {
+		stats.nodes = 1;
+		return stats;
+	}
+	chImpl->_perftStats(depth, stats);
+	return stats;
+}
+
+std::map<std::string, uint64_t> Chess::perftDivide(int depth) {
+	std::map<std::string, uint64_t> result;
+	if (depth <= 0) return result;
+
+	for (const auto& m : chImpl->_moves(true)) {
 		chImpl->_makeMove(m);
-		if (!chImpl->_isKingAttacked(c))
-			nodes += perft(depth - 1);
+		result[Helper::moveToLan(m)] = chImpl->_perft(depth - 1);
 		chImpl->_undoMove();
 	}
-	return nodes;
+	return result;
+}
+
+void Chess::setPerftHashSize(size_t megabytes) {
+	chImpl->_perftTable = megabytes > 0 ? std::make_shared<PerftTable>(megabytes) : nullptr;
 }
 
 std::pair<bool, bool> Chess::getCastlingRights(Color c) {
@@ -737,17 +741,16 @@ std::pair<bool, bool> Chess::getCastlingRights(Color c) {
 }
 
 void Chess::clear(std::optional<bool> preserveHeaders) {
-	chImpl->_board = std::array<Piece, 128>();
-	chImpl->_kings = KingPositions();
+	chImpl->_clearBoard();
 	chImpl->_turn = WHITE;
 	chImpl->_castlings = 0;
 	chImpl->_epSquare = EMPTY;
 	chImpl->_halfMoves = 0;
 	chImpl->_moveNumber = 1;
 	chImpl->_history = {};
+	chImpl->_historyText = {};
 	chImpl->_comments = {};
 	chImpl->_header = preserveHeaders ? chImpl->_header : std::map<std::string, std::string>();
-	chImpl->_positionCount = {};
 
 	chImpl->_header.erase("SetUp");
 	chImpl->_header.erase("FEN");
@@ -770,18 +773,18 @@ std::vector<std::vector<std::optional<std::tuple<Square, PieceSymbol, Color>>>>
 	std::vector<std::vector<std::optional<std::tuple<Square, PieceSymbol, Color>>>> output = {};
 	std::vector<std::optional<std::tuple<Square, PieceSymbol, Color>>> row = {};
 
-	for (int i = Ox88.at((int)(Square::a8)); i <= Ox88.at((int)(Square::h1)); i++) {
+	for (int i = static_cast<int>(Square::a8); i <= static_cast<int>(Square::h1); i++) {
 		if (!chImpl->_board[i]) {
 			row.push_back(std::nullopt);
 		}
 		else {
 			row.push_back(std::tuple<Square, PieceSymbol, Color>{
-				algebraic(i),
+				static_cast<Square>(i),
 					chImpl->_board[i].type,
 					chImpl->_board[i].color
 			});
 		}
-		if ((i + 1) & 0x88) {
+		if ((i & 7) == 7) {
 			std::vector<std::optional<std::tuple<Square, PieceSymbol, Color>>> trow;
 			for (const auto& elem : row) {
 				if (elem.has_value()) {
@@ -790,14 +793,13 @@ std::vector<std::vector<std::optional<std::tuple<Square, PieceSymbol, Color>>>>
 			}
 			output.push_back(std::move(trow));
 			row = {};
-			i += 8;
 		}
 	}
 	return output;
 }
 
 bool Chess::isAttacked(Square sq, Color attackedBy) {
-	return chImpl->_attacked(attackedBy, Ox88.at((int)(sq)));
+	return chImpl->_attacked(attackedBy, static_cast<int>(sq));
 }
 
 bool Chess::isCheck() {
@@ -812,55 +814,30 @@ bool Chess::inSufficientMaterial() {
 	 * k.b. vs k.n. with mate in 1:
 	 * 8/8/8/8/1n6/8/B7/K1k5 b - - 2 1
 	 */
-	std::map<PieceSymbol, int> pieces = {
-		{BISHOP, 0},
-		{KNIGHT, 0},
-		{ROOK, 0},
-		{QUEEN, 0},
-		{KING, 0},
-		{PAWN, 0},
-	};
-	std::vector<int> bishops = {};
-	int numPieces = 0;
-	int squareColor = 0;
-	for (int i = 0; i <= 119; i++) {
-		squareColor = (squareColor + 1) % 2;
-		if (i & 0x88) {
-
-			i += 7;
-			continue;
-		}
-
-		if (chImpl->_board[i]) {
-			pieces.at(chImpl->_board[i].type) = pieces.count(chImpl->_board[i].type) > 0 ? pieces.at(chImpl->_board[i].type) + 1 : 1;
-			if (chImpl->_board[i].type == BISHOP) {
-				bishops.push_back(squareColor);
-			}
-			numPieces++;
-		}
-	}
+	const Bitboard occupied = chImpl->_occupied();
+	const Bitboard bishops = chImpl->_pieces[static_cast<int>(BISHOP)];
+	const int numPieces = Bitboards::popCount(occupied);
+	const int numBishops = Bitboards::popCount(bishops);
 
 	if (numPieces == 2) {
 		return true;
 	}
-	else if (numPieces == 3 && (pieces.at(BISHOP) == 1 || pieces.at(KNIGHT) == 1)) {
+	else if (numPieces == 3 && (numBishops == 1 || chImpl->_pieces[static_cast<int>(KNIGHT)])) {
 		return true;
 	}
-	else if (numPieces == pieces.at(BISHOP) + 2) {
-		int sum = 0;
-		const int len = static_cast<int>(bishops.size());
-		for (int i = 0; i < len; i++) {
-			sum += bishops[i];
-		}
-		if (sum == 0 || sum == len) {
-			return true;
-		}
+	else if (numPieces == numBishops + 2) {
+		// Only kings and bishops left: drawn when every bishop stands on the same square color.
+		return !(bishops & LIGHT_SQUARES_BB) || !(bishops & ~LIGHT_SQUARES_BB);
 	}
 	return false;
 }
 
 bool Chess::isThreefoldRepetition() {
-	return chImpl->_getPositionCount(fen()) >= 3;
+	return chImpl->_repetitionCount() >= 3;
+}
+
+uint64_t Chess::hash() {
+	return chImpl->_hash();
 }
 
 bool Chess::put(PieceSymbol type, Color c, Square sq) {
@@ -874,25 +851,36 @@ bool Chess::put(PieceSymbol type, Color c, Square sq) {
 }
 
 std::vector<Move> Chess::getMoves(bool verbose, std::string sq, PieceSymbol piece) {
-	std::vector<InternalMove> generatedMoves = chImpl->_moves(true, piece, sq);
+	// SAN disambiguation has to see every legal move, not only the ones asked for.
+	const MoveList legal = chImpl->_moves(true);
+	const MoveList generatedMoves = (sq.empty() && piece == PieceSymbol::NONE) ? legal : chImpl->_moves(true, piece, sq);
+
+	std::vector<std::string> sans;
+	chImpl->_movesToSan(generatedMoves, legal, sans);
+	const std::string before = verbose ? fen() : "";
 
 	std::vector<Move> result;
-	for (const auto& internal: generatedMoves) {
+	result.reserve(generatedMoves.size());
+	for (size_t i = 0; i < generatedMoves.size(); i++) {
+		const PackedMove packed = generatedMoves[i];
+		const InternalMove internal = chImpl->_unpack(packed);
 		Move mv;
 
 		mv.color = internal.color;
-		mv.from = algebraic(internal.from);
-		mv.to = algebraic(internal.to);
+		mv.from = static_cast<Square>(internal.from);
+		mv.to = static_cast<Square>(internal.to);
 		mv.piece = internal.piece;
 		mv.captured = internal.captured;
 		mv.promotion = internal.promotion;
-		mv.flags = internal.flags;
+		mv.flags = Helper::flagsToString(internal.flags);
+		mv.san = sans[i];
 
 		if (verbose) {
-			mv.san = chImpl->_makePretty(internal).san;
-		}
-		else {
-			mv.san = chImpl->_moveToSan(internal, generatedMoves);
+			mv.lan = Helper::moveToLan(packed);
+			mv.before = before;
+			chImpl->_makeMove(packed);
+			mv.after = fen();
+			chImpl->_undoMove();
 		}
 
 		result.push_back(mv);
@@ -900,17 +888,18 @@ std::vector<Move> Chess::getMoves(bool verbose, std::string sq, PieceSymbol piec
 	return result;
 }
 
+void Chess::getMoves(MoveList& moves) {
+	moves = chImpl->_moves(true);
+}
+
 std::vector<std::string> Chess::getMoves() {
-	std::vector<InternalMove> generatedMoves = chImpl->_moves(true);
+	const MoveList generatedMoves = chImpl->_moves(true);
 
 	std::vector<std::string> result;
-
-	for (const auto& internal: generatedMoves) {
-		result.push_back(chImpl->_moveToSan(internal, generatedMoves));
-	}
-
+	chImpl->_movesToSan(generatedMoves, generatedMoves, result);
 	return result;
 }
+
 std::string Chess::getComment() {
 	return chImpl->_comments.at(fen());
 }
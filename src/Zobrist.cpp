@@ -0,0 +1,55 @@
+#include "Zobrist.h"
+#include <mutex>
+
+using namespace ChessCpp;
+
+uint64_t Zobrist::PIECE_KEYS[2][6][64];
+uint64_t Zobrist::CASTLING_KEYS[16];
+uint64_t Zobrist::EN_PASSANT_KEYS[8];
+uint64_t Zobrist::SIDE_KEY;
+
+namespace {
+	// splitmix64; a fixed seed keeps hashes stable between runs and builds.
+	class KeyRng {
+	public:
+		uint64_t next() {
+			uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			return z ^ (z >> 31);
+		}
+	private:
+		uint64_t state = 0x43686573734370ULL;
+	};
+}
+
+void Zobrist::init() {
+	static std::once_flag once;
+	std::call_once(once, []() {
+		KeyRng rng;
+		for (auto& color : PIECE_KEYS) {
+			for (auto& piece : color) {
+				for (auto& key : piece) {
+					key = rng.next();
+				}
+			}
+		}
+
+		// Each right gets its own key; combinations are XORs of the individual ones.
+		uint64_t rightKeys[4];
+		for (auto& key : rightKeys) {
+			key = rng.next();
+		}
+		for (int i = 0; i < 16; i++) {
+			CASTLING_KEYS[i] = 0;
+			for (int bit = 0; bit < 4; bit++) {
+				if (i & (1 << bit)) CASTLING_KEYS[i] ^= rightKeys[bit];
+			}
+		}
+
+		for (auto& key : EN_PASSANT_KEYS) {
+			key = rng.next();
+		}
+		SIDE_KEY = rng.next();
+	});
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "../include/libtypes"
+#include <cstdint>
+
+using namespace ChessCpp;
+
+// Random keys for incremental position hashing. A position's key is the XOR of the keys of its
+// pieces, its castling rights, a capturable en passant file and the side to move.
+class Zobrist {
+public:
+    /// Fills the key tables. Safe to call more than once, and from several threads.
+    static void init();
+
+    static inline uint64_t piece(const Piece& p, int sq) {
+        return PIECE_KEYS[static_cast<int>(p.color)][static_cast<int>(p.type)][sq];
+    }
+
+    static inline uint64_t castling(uint16_t rights) {
+        const int index =
+            ((rights & CASTLE_WK) ? 1 : 0) |
+            ((rights & CASTLE_WQ) ? 2 : 0) |
+            ((rights & CASTLE_BK) ? 4 : 0) |
+            ((rights & CASTLE_BQ) ? 8 : 0);
+        return CASTLING_KEYS[index];
+    }
+
+    static inline uint64_t enPassant(int sq) {
+        return EN_PASSANT_KEYS[sq & 7];
+    }
+
+    /// XORed in when black is to move.
+    static inline uint64_t side() {
+        return SIDE_KEY;
+    }
+
+private:
+    static uint64_t PIECE_KEYS[2][6][64];
+    static uint64_t CASTLING_KEYS[16];
+    static uint64_t EN_PASSANT_KEYS[8];
+    static uint64_t SIDE_KEY;
+};
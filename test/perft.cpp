@@ -1,7 +1,7 @@
 #include <iostream>
-#include <cstdlib>
 #include "../include/chesscpp"
 #include <chrono>
+#include <thread>
 
 using namespace std::literals::chrono_literals;
 
@@ -14,12 +14,13 @@ int main() {
     ChessCpp::Chess game = ChessCpp::Chess(optFEN2);
 
     int analyzeDepth = 5;
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
 
     std::string initialFEN = game.fen();
 
     for (int i = 1; i <= analyzeDepth; i++) {
         const auto startTime = std::chrono::high_resolution_clock::now();
-        uint64_t perftResult = game.perft(i);
+        uint64_t perftResult = game.perft(i, threads, 2);
         const auto endTime = std::chrono::high_resolution_clock::now();
         auto elapsed = endTime - startTime;
         double timeInSec = elapsed / 1.0s;
@@ -30,9 +31,9 @@ int main() {
             << " time " << elapsed / 1ms
             << " nodes " << perftResult
             << " nps " << nodePerSec
+            << " threads " << threads
             << " fen " << initialFEN
             << '\n';
     }
-    system("pause");
     return 0;
 }
@@ -0,0 +1,40 @@
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include "../include/pgnindex"
+
+using namespace std::literals::chrono_literals;
+
+// Indexes a PGN file and prints a game from it.
+// Usage: pgn-index <file.pgn> [game number]
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cout << "Usage: pgn-index <file.pgn> [game number]" << std::endl;
+        return 1;
+    }
+
+    try {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+        ChessCpp::PgnIndex index(argv[1]);
+        const auto endTime = std::chrono::high_resolution_clock::now();
+
+        std::cout << index.size() << " games, index " << (index.fromSidecar() ? "read" : "built")
+            << " in " << (endTime - startTime) / 1.0ms << " ms" << std::endl;
+
+        if (argc > 2) {
+            const size_t n = static_cast<size_t>(std::strtoull(argv[2], nullptr, 10));
+            const ChessCpp::PgnIndexEntry entry = index.entry(n);
+            std::cout << entry.white << " - " << entry.black << " " << entry.result
+                << " (" << entry.eco << ", " << entry.date << "), bytes " << entry.offset << "+" << entry.length << std::endl;
+
+            ChessCpp::Chess game;
+            index.load(n, game);
+            std::cout << game.pgn() << std::endl << game.fen() << std::endl;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,641 @@
+#include "../include/chesscpp"
+#include "../include/pgnimport"
+#include "../include/pgnindex"
+#include "../include/pgnreader"
+#include "../include/polyglot"
+#include "../include/tablebase"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace ChessCpp;
+
+// Checks results the library must reproduce exactly. Runs unattended: prints each failed check
+// and exits with a non-zero status when there was one.
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const std::string& what) {
+        if (!ok) {
+            std::cout << "FAIL " << what << '\n';
+            failures++;
+        }
+    }
+
+    // Node counts from the published perft tables, with the depths kept small enough to run in seconds.
+    const struct {
+        const char* fen;
+        int depth;
+        uint64_t nodes;
+    } PERFT_COUNTS[] = {
+        { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4, 197281 },
+        { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862 },
+        { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624 },
+        { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333 },
+        { "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379 },
+        { "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 3, 89890 },
+        { "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6, 1440467 },
+    };
+
+    void perftCounts() {
+        for (const auto& p : PERFT_COUNTS) {
+            Chess game(p.fen);
+            check(game.perft(p.depth) == p.nodes, std::string("perft ") + std::to_string(p.depth) + " of " + p.fen);
+            check(game.perft(p.depth, 4) == p.nodes, std::string("parallel perft ") + std::to_string(p.depth) + " of " + p.fen);
+            check(game.perft(p.depth, 3, 2) == p.nodes, std::string("parallel perft split at 2 plies, ") + std::to_string(p.depth) + " of " + p.fen);
+            check(game.fen() == p.fen, std::string("perft leaves the position as it was: ") + p.fen);
+        }
+    }
+
+    void perftStatistics() {
+        // Leaf counts from the published perft tables: nodes, captures, en passant captures, castles,
+        // promotions, checks, discovered checks, double checks and checkmates.
+        const struct {
+            const char* fen;
+            int depth;
+            int64_t counts[9];
+        } tables[] = {
+            { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4, { 197281, 1576, 0, 0, 0, 469, 0, 0, 8 } },
+            { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, { 97862, 17102, 45, 3162, 0, 993, 0, 0, 1 } },
+            { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, { 674624, 52051, 1165, 0, 0, 52950, 1292, 3, 0 } },
+            { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, { 9467, 1021, 4, 0, 120, 38, 2, 0, 22 } },
+        };
+        for (const auto& t : tables) {
+            PerftStats stats = Chess(t.fen).perftStats(t.depth);
+            const int64_t counts[9] = { stats.nodes, stats.captures, stats.enPassants, stats.castles, stats.promotions,
+                stats.checks, stats.discoveredChecks, stats.doubleChecks, stats.checkmates };
+            check(std::equal(counts, counts + 9, t.counts), std::string("perftStats ") + std::to_string(t.depth) + " of " + t.fen);
+        }
+
+        Chess game;
+        std::map<std::string, uint64_t> divide = game.perftDivide(3);
+        uint64_t total = 0;
+        for (const auto& [move, nodes] : divide) {
+            total += nodes;
+        }
+        check(divide.size() == 20 && total == 8902 && divide["e2e4"] == 600 && divide["g1f3"] == 440 && divide["a2a3"] == 380,
+            "perftDivide 3 of the starting position");
+    }
+
+    // An unvalidated position with more moves than any legal one: the move lists must hold them all.
+    void crowdedBoard() {
+        Chess game("QQQQQQQQ/Q6Q/Q6Q/Q6Q/Q6Q/Q6Q/Q6Q/QQQQQQQk w - - 0 1", true);
+        check(game.perft(1) == 285 && game.perft(1, 4) == 285 && game.getMoves().size() == 285, "285 moves for 29 queens");
+    }
+
+    // A second count reads the subtrees the first one stored, and a 1 MB table forces replacements.
+    void hashedPerft() {
+        for (size_t megabytes : { 16, 1 }) {
+            for (const auto& p : PERFT_COUNTS) {
+                Chess game(p.fen);
+                game.setPerftHashSize(megabytes);
+                const std::string what = std::to_string(p.depth) + " of " + p.fen + " with a " + std::to_string(megabytes) + " MB table";
+                check(game.perft(p.depth) == p.nodes, "hashed perft " + what);
+                check(game.perft(p.depth) == p.nodes, "repeated hashed perft " + what);
+                check(game.perft(p.depth, 4, 2) == p.nodes, "parallel hashed perft " + what);
+            }
+        }
+    }
+
+    // Every legal move is played again from its SAN and from its LAN, and must land on the same position.
+    void sanRoundTrip() {
+        const char* fens[] = {
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+            "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+            "4k3/2r5/8/1N6/8/5N2/8/1N2K3 w - - 0 1",
+        };
+        for (const char* fen : fens) {
+            Chess game(fen);
+            for (const Move& move : game.getMoves(true)) {
+                for (const std::string& text : { move.san, move.lan }) {
+                    Chess copy(fen);
+                    Move played = copy.makeMove(text);
+                    check(played.san == move.san && played.lan == move.lan && copy.fen() == move.after,
+                        "playing " + text + " from " + fen);
+                    copy.undo();
+                    check(copy.fen() == fen, "undoing " + text + " from " + fen);
+                }
+            }
+        }
+
+        const std::vector<std::string> kiwipete = Chess(fens[0]).getMoves();
+        const std::vector<std::string> knights = Chess(fens[3]).getMoves();
+        auto has = [](const std::vector<std::string>& moves, const char* san) {
+            return std::find(moves.begin(), moves.end(), san) != moves.end();
+        };
+        check(has(kiwipete, "O-O") && has(kiwipete, "O-O-O") && has(kiwipete, "dxe6") && has(kiwipete, "Bxa6"), "SAN of castling and captures");
+        check(has(knights, "Nbd2") && has(knights, "Nfd2") && has(knights, "N1c3") && has(knights, "N5c3") && has(knights, "Nxc7+"), "SAN disambiguated by file and by rank");
+    }
+
+    // A game written with pgn() loads back to the same moves, position and text, through loadPgn
+    // and through PgnReader.
+    void pgnRoundTrip() {
+        Chess game;
+        game.header({ "White", "Ann", "Black", "Bob", "Result", "1-0" });
+        for (const char* san : { "e4", "d5", "e5", "f5", "exf6", "Nc6", "fxg7", "Bf5", "gxh8=Q", "Qd7", "Nf3", "O-O-O", "Be2", "Nf6", "O-O" }) {
+            game.makeMove(std::string(san));
+        }
+        const std::string text = game.pgn();
+        check(text.find("\n\n1. e4 d5 2. e5 f5 3. exf6 Nc6 4. fxg7 Bf5 5. gxh8=Q Qd7 6. Nf3 O-O-O 7. Be2 Nf6 8. O-O 1-0") != std::string::npos,
+            "PGN movetext");
+
+        Chess loaded;
+        loaded.loadPgn(text);
+        check(loaded.fen() == game.fen() && loaded.history_s() == game.history_s() && loaded.pgn() == text, "PGN loaded back");
+
+        std::string wrapped = game.pgn('\n', 40);
+        for (size_t at = wrapped.find('\n'); at != std::string::npos; at = wrapped.find('\n', at + 2)) {
+            wrapped.insert(at, 1, '\r');
+        }
+        Chess crlf;
+        crlf.loadPgn(wrapped);
+        check(crlf.fen() == game.fen() && crlf.pgn() == text, "wrapped PGN with CRLF line endings loaded back");
+
+        std::istringstream file(text + "\n\n[White \"C\"]\n[Black \"D\"]\n\n1. f3 e5 2. g4 Qh4# 0-1\n");
+        PgnReader reader(file);
+        PgnGame first, second, none;
+        check(reader.next(first) && reader.next(second) && !reader.next(none), "PgnReader reads two games");
+        check(first.error.empty() && first.header("White") == std::string("Ann") && first.moves.size() == 15 && first.result == "1-0",
+            "first game read by PgnReader");
+        check(second.error.empty() && second.moves.size() == 4 && second.result == "0-1", "second game read by PgnReader");
+        Chess streamed;
+        streamed.loadPgn(first);
+        check(streamed.fen() == game.fen() && streamed.pgn() == text, "game from PgnReader loaded back");
+        streamed.loadPgn(second);
+        check(streamed.isCheckmate() && streamed.history_s().size() == 4, "second game from PgnReader loaded");
+    }
+
+    void fenRoundTrip() {
+        const char* fens[] = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+            "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+            "r3k3/8/8/8/8/8/8/4K2R b Kq - 99 150",
+        };
+        for (const char* fen : fens) {
+            Chess game(fen);
+            char buffer[FEN_BUFFER_SIZE];
+            const size_t length = game.fen(buffer, sizeof(buffer));
+            check(game.fen() == fen && length == game.fen().size() && game.fen() == buffer, std::string("FEN written back: ") + fen);
+
+            char shortBuffer[10];
+            check(game.fen(shortBuffer, sizeof(shortBuffer)) == length && std::string(shortBuffer) == std::string(fen, 9),
+                std::string("FEN cut short to its buffer: ") + fen);
+
+            // Every position one move on is written and read back the same.
+            for (const Move& move : game.getMoves(true)) {
+                check(Chess(move.after).fen() == move.after, "FEN read back: " + move.after);
+            }
+        }
+
+        const char* invalid[] = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - -1 1",
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN w KQkq - 0 1",
+            "rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1",
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e4 0 1",
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQQBNR w KQkq - 0 1",
+        };
+        for (const char* fen : invalid) {
+            bool threw = false;
+            try {
+                Chess game(fen);
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            check(!validateFen(fen).first && threw, std::string("invalid FEN rejected: ") + fen);
+        }
+
+        // load() completes a FEN missing its last fields, which validateFen alone does not accept.
+        const char* shortFen = "4k3/8/8/8/8/8/8/4K2R w K";
+        check(!validateFen(shortFen).first && Chess(shortFen).fen() == "4k3/8/8/8/8/8/8/4K2R w K - 0 1", "short FEN completed");
+    }
+
+    // Some of these positions have more than one mating line, so the moves are not compared. Instead the
+    // best move must leave the other side mated, or facing the same mate one move shorter.
+    void mateSearch() {
+        const struct {
+            const char* fen;
+            int mate;
+        } mates[] = {
+            { "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", 1 },
+            { "r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 0 1", 1 },
+            { "kbK5/pp6/1P6/8/8/8/8/R7 w - - 0 1", 2 },
+            { "k7/8/1K6/8/8/8/8/7R b - - 0 1", -1 },
+        };
+        for (const auto& m : mates) {
+            for (int threads : { 1, 4 }) {
+                Chess game(m.fen);
+                SearchLimits limits;
+                limits.depth = 8;
+                limits.threads = threads;
+                SearchResult result = game.search(limits);
+                const std::string what = "mate in " + std::to_string(m.mate) + " with " + std::to_string(threads) + " threads: " + m.fen;
+                check(game.fen() == m.fen, "search leaves the position as it was: " + what);
+                check(result.mate == m.mate && !result.pv.empty() && result.pv[0] == result.bestMove, what);
+
+                game.makeMove(result.bestMove);
+                if (m.mate == 1) {
+                    check(game.isCheckmate(), "best move mates: " + what);
+                }
+                else {
+                    const int reply = m.mate > 0 ? 1 - m.mate : -m.mate;
+                    check(game.search(limits).mate == reply, "best move keeps the mate: " + what);
+                }
+            }
+        }
+
+        SearchResult mated = Chess("rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3").search();
+        check(mated.bestMove.empty() && mated.mate == 0, "no best move when the side to move is mated");
+    }
+
+    // FEN of a position with White to move, from a board indexed a8 = 0 to h1 = 63.
+    std::string fenOf(const char (&board)[64]) {
+        std::string fen;
+        for (int rank = 0; rank < 8; rank++) {
+            int empty = 0;
+            for (int file = 0; file < 8; file++) {
+                const char piece = board[rank * 8 + file];
+                if (!piece) {
+                    empty++;
+                    continue;
+                }
+                if (empty) fen += static_cast<char>('0' + empty);
+                empty = 0;
+                fen += piece;
+            }
+            if (empty) fen += static_cast<char>('0' + empty);
+            if (rank < 7) fen += '/';
+        }
+        return fen + " w - - 0 1";
+    }
+
+    void tablebaseProbes() {
+        const std::filesystem::path directory = std::filesystem::temp_directory_path() / "chesscpp-regression-tb";
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        check(Tablebase::generate("KQK", directory.string()) == 2 && Tablebase::generate("KRK", directory.string()) == 2,
+            "KQK and KRK generated with KK");
+        {
+            Tablebase tables(directory.string());
+            check(tables.size() == 3, "three tables loaded");
+
+            const struct {
+                const char* fen;
+                int wdl;
+                int dtm;
+            } probes[] = {
+                { "k7/8/1K6/8/8/8/8/7R w - - 0 1", 1, 1 },
+                { "k7/8/1K6/8/8/8/8/7R b - - 0 1", -1, 2 },
+                { "k7/8/1K6/8/8/8/8/R7 b - - 0 1", -1, 4 },
+                { "8/8/8/8/8/8/1Q6/k1K5 b - - 0 1", -1, 0 },
+                { "k7/2Q5/1K6/8/8/8/8/8 b - - 0 1", 0, 0 },
+                { "k7/1Q6/8/8/8/8/8/7K b - - 0 1", 0, 0 },
+            };
+            for (const auto& p : probes) {
+                std::optional<TablebaseResult> result = tables.probe(Chess(p.fen));
+                check(result && result->wdl == p.wdl && result->dtm == p.dtm, std::string("tablebase probe of ") + p.fen);
+            }
+            check(!tables.probe(Chess("8/8/8/8/4k3/8/8/R3K3 w Q - 0 1")), "no probe with castling rights");
+            check(!tables.probe(Chess("8/8/8/8/4k3/8/4P3/4K3 w - - 0 1")), "no probe without the table");
+
+            // The longest wins are mate in 10 with the queen and mate in 16 with the rook.
+            for (const char piece : { 'Q', 'R' }) {
+                int longest = 0;
+                for (int king = 0; king < 64; king++) {
+                    for (int other = 0; other < 64; other++) {
+                        for (int square = 0; square < 64; square++) {
+                            const bool apart = std::abs(king % 8 - other % 8) > 1 || std::abs(king / 8 - other / 8) > 1;
+                            if (!apart || square == king || square == other) continue;
+                            char board[64] = {};
+                            board[king] = 'K';
+                            board[other] = 'k';
+                            board[square] = piece;
+                            std::optional<TablebaseResult> result = tables.probe(Chess(fenOf(board), true));
+                            if (result && result->wdl == 1) longest = std::max(longest, result->dtm);
+                        }
+                    }
+                }
+                check(longest == (piece == 'Q' ? 19 : 31), std::string("longest K") + piece + "K win");
+            }
+        }
+        std::filesystem::remove_all(directory);
+    }
+
+    // Games written with binary() one after another read back in turn to the same headers, moves and position.
+    void binaryRoundTrip() {
+        Chess opening;
+        opening.header({ "White", "Ann", "Black", "Bob", "Result", "1-0" });
+        for (const char* san : { "e4", "d5", "e5", "f5", "exf6", "Nc6", "fxg7", "Bf5", "gxh8=Q", "Qd7", "Nf3", "O-O-O", "Be2", "Nf6", "O-O" }) {
+            opening.makeMove(std::string(san));
+        }
+
+        // Fixed-seed random play from a position with promotions and castling on both sides.
+        Chess random("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1");
+        std::mt19937 rng(2024);
+        for (int ply = 0; ply < 300 && !random.isGameOver(); ply++) {
+            const std::vector<std::string> moves = random.getMoves();
+            random.makeMove(moves[rng() % moves.size()]);
+        }
+
+        const std::string first = opening.binary();
+        const std::string second = random.binary();
+        const std::string data = first + second;
+        Chess loaded;
+        const size_t used = loaded.loadBinary(data.data(), data.size());
+        check(used == first.size() && loaded.fen() == opening.fen() && loaded.pgn() == opening.pgn(), "first binary game read back");
+        const size_t next = loaded.loadBinary(data.data() + used, data.size() - used);
+        check(next == second.size() && loaded.fen() == random.fen() && loaded.pgn() == random.pgn() && loaded.history_s() == random.history_s(),
+            "second binary game read back, " + std::to_string(random.history_s().size()) + " plies");
+
+        bool threw = false;
+        try {
+            loaded.loadBinary(second.data(), second.size() - 1);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        check(threw, "truncated binary game rejected");
+    }
+
+    // Replayed in parallel, each game must come out as a serial loadPgn leaves it, whether the games
+    // are delivered in input order or as they are ready.
+    void parallelImport() {
+        std::string text;
+        std::mt19937 rng(7);
+        for (int g = 0; g < 300; g++) {
+            Chess game;
+            game.header({ "White", "W" + std::to_string(g), "Black", "B" + std::to_string(g) });
+            const int plies = 1 + static_cast<int>(rng() % 120);
+            for (int ply = 0; ply < plies && !game.isGameOver(); ply++) {
+                const std::vector<std::string> moves = game.getMoves();
+                game.makeMove(moves[rng() % moves.size()]);
+            }
+            text += game.pgn() + "\n\n";
+            if (g == 100) text += "[White \"illegal\"]\n\n1. e4 e5 2. Ke3 Nc6 *\n\n";
+            if (g == 200) text += "[White \"unterminated\n\n1. d4 d5 *\n\n";
+        }
+
+        struct Replay {
+            size_t plies;
+            std::string fen;
+            bool failed;
+        };
+        std::vector<Replay> serial;
+        PgnReader reader(text.data(), text.size());
+        PgnGame game;
+        while (reader.next(game)) {
+            Chess board;
+            bool failed = !game.error.empty();
+            try {
+                board.loadPgn(game);
+            } catch (const std::exception&) {
+                failed = true;
+            }
+            serial.push_back({ board.history_s().size(), board.fen(), failed });
+        }
+        check(serial.size() == 302 && serial[101].failed && serial[101].plies == 2 && serial[202].failed, "serial replay of the import test games");
+
+        for (bool ordered : { true, false }) {
+            std::vector<bool> seen(serial.size(), false);
+            bool inOrder = true;
+            bool same = true;
+            size_t next = 0;
+            std::istringstream in(text);
+            const size_t delivered = PgnImporter(4, ordered).run(in, [&](ImportedGame& g) {
+                inOrder = inOrder && g.index == next++;
+                if (g.index >= serial.size() || seen[g.index]) {
+                    same = false;
+                    return true;
+                }
+                seen[g.index] = true;
+                const Replay& r = serial[g.index];
+                same = same && g.moves.size() == r.plies && g.fen == r.fen && g.error.empty() != r.failed;
+                return true;
+            });
+            const std::string what = ordered ? "ordered" : "unordered";
+            check(delivered == serial.size() && std::count(seen.begin(), seen.end(), true) == static_cast<long>(serial.size()) && same,
+                what + " parallel import matches serial loadPgn");
+            check(!ordered || inOrder, "ordered parallel import delivers in input order");
+        }
+
+        size_t calls = 0;
+        std::istringstream in(text);
+        const size_t delivered = PgnImporter(4).run(in, [&](ImportedGame&) { return ++calls < 10; });
+        check(delivered == 10 && calls == 10, "parallel import stops when the callback returns false");
+    }
+
+    bool sameMove(const Move& a, const Move& b) {
+        return a.color == b.color && a.from == b.from && a.to == b.to && a.piece == b.piece && a.captured == b.captured &&
+            a.promotion == b.promotion && a.flags == b.flags && a.san == b.san && a.lan == b.lan &&
+            a.before == b.before && a.after == b.after;
+    }
+
+    // Random games played through makeMove and playMove side by side. Each record must build the Move
+    // makeMove returned, also once the game has moved on.
+    void moveRecords() {
+        const char* fens[] = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+            "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+            "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+        };
+        std::mt19937 rng(11);
+        std::string flagsSeen;
+        for (const char* fen : fens) {
+            for (int g = 0; g < 20; g++) {
+                Chess made(fen);
+                Chess played(fen);
+                std::vector<Move> moves;
+                std::vector<MoveRecord> records;
+                for (int ply = 0; ply < 80 && !made.isGameOver(); ply++) {
+                    // En passant captures are rare in random play, so they are always taken.
+                    const std::vector<Move> legal = made.getMoves(true);
+                    std::string san = legal[rng() % legal.size()].san;
+                    for (const Move& m : legal) {
+                        if (m.flags.find('e') != std::string::npos) san = m.san;
+                    }
+                    moves.push_back(made.makeMove(san));
+                    records.push_back(played.playMove(san));
+
+                    const Move& m = moves.back();
+                    const MoveRecord& r = records.back();
+                    flagsSeen += m.flags;
+                    check(r.color == m.color && r.from == m.from && r.to == m.to && r.piece == m.piece && r.captured == m.captured &&
+                        r.promotion == m.promotion && r.san() == m.san && r.lan() == m.lan && r.flags() == m.flags &&
+                        r.before() == m.before && r.after() == m.after && sameMove(r.toMove(), m),
+                        "MoveRecord of " + m.san + " from " + m.before);
+                }
+                check(played.fen() == made.fen(), std::string("playMove reaches the same position from ") + fen);
+
+                // Records are kept as positions of their own, so undoing the game leaves them intact.
+                while (played.undo()) {}
+                for (size_t i = 0; i < records.size(); i++) {
+                    check(sameMove(records[i].toMove(), moves[i]), "MoveRecord after the game was undone: " + moves[i].san);
+                }
+            }
+        }
+        for (char flag : { 'c', 'e', 'k', 'q', 'p', 'b' }) {
+            check(flagsSeen.find(flag) != std::string::npos, std::string("random games played a move with flag ") + flag);
+        }
+    }
+
+    // The evaluation terms are updated as pieces move; they must always equal those of the same position
+    // set up from scratch, through moves, undos and pieces put on or removed from the board.
+    void incrementalEvaluation() {
+        const char* fens[] = {
+            "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+            "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+            "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+            "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+        };
+        std::mt19937 rng(5);
+        int mismatches = 0;
+        for (const char* fen : fens) {
+            for (int g = 0; g < 20; g++) {
+                Chess game(fen);
+                for (int step = 0; step < 120 && !game.isGameOver(); step++) {
+                    if (rng() % 4 == 0) {
+                        game.undo();
+                    }
+                    else {
+                        const std::vector<std::string> moves = game.getMoves();
+                        game.makeMove(moves[rng() % moves.size()]);
+                    }
+                    if (Chess(game.fen()).evaluate() != game.evaluate()) mismatches++;
+                }
+
+                // A piece other than a king taken off, and a knight put on an empty square.
+                const std::string files = "abcdefgh";
+                for (int square = static_cast<int>(rng() % 64), tries = 0; tries < 64; square = (square + 1) % 64, tries++) {
+                    const Square sq = stringToSquare(std::string(1, files[square % 8]) + static_cast<char>('1' + square / 8));
+                    const Piece piece = game.get(sq);
+                    if (piece && piece.type != PieceSymbol::k) {
+                        game.remove(sq);
+                        break;
+                    }
+                }
+                if (Chess(game.fen()).evaluate() != game.evaluate()) mismatches++;
+                for (int square = static_cast<int>(rng() % 64), tries = 0; tries < 64; square = (square + 1) % 64, tries++) {
+                    const Square sq = stringToSquare(std::string(1, files[square % 8]) + static_cast<char>('1' + square / 8));
+                    if (!game.get(sq)) {
+                        game.put(PieceSymbol::n, Color::b, sq);
+                        break;
+                    }
+                }
+                if (Chess(game.fen()).evaluate() != game.evaluate()) mismatches++;
+            }
+        }
+        check(mismatches == 0, std::to_string(mismatches) + " incremental evaluations differ from a fresh one");
+    }
+
+    void zobristKeys() {
+        // After e4 the pawn on d4 attacks e3 but is pinned against its king, so the FEN leaves the
+        // en passant square out and the key must too.
+        Chess game("8/8/8/8/k2p3R/8/4P3/4K3 w - - 0 1");
+        game.makeMove("e4");
+        check(game.hash() == Chess(game.fen()).hash(), "hash after a double push with a pinned capturer matches its FEN");
+
+        Chess open("rnbqkbnr/ppp1pppp/8/8/3p4/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+        open.makeMove("e4");
+        check(open.fen() == "rnbqkbnr/ppp1pppp/8/8/3pP3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1", "en passant square in the FEN");
+        check(open.hash() == Chess(open.fen()).hash(), "hash after a double push with a capture matches its FEN");
+    }
+
+    // Reference keys from the Polyglot book format description.
+    void polyglotKeys() {
+        const struct {
+            const char* moves;
+            uint64_t key;
+        } games[] = {
+            { "", 0x463b96181691fc9cULL },
+            { "e4", 0x823c9b50fd114196ULL },
+            { "e4 d5", 0x0756b94461c50fb0ULL },
+            { "e4 d5 e5", 0x662fafb965db29d4ULL },
+            { "e4 d5 e5 f5", 0x22a48b5a8e47ff78ULL },
+            { "e4 d5 e5 f5 Ke2", 0x652a607ca3f242c1ULL },
+            { "e4 d5 e5 f5 Ke2 Kf7", 0x00fdd303c946bdd9ULL },
+            { "a4 b5 h4 b4 c4", 0x3c8123ea7b067637ULL },
+            { "a4 b5 h4 b4 c4 bxc3 Ra3", 0x5c3f9b829b279560ULL },
+        };
+        for (const auto& g : games) {
+            Chess game;
+            std::istringstream moves(g.moves);
+            std::string san;
+            while (moves >> san) {
+                game.makeMove(san);
+            }
+            check(PolyglotBook::key(game) == g.key, std::string("Polyglot key after \"") + g.moves + "\"");
+        }
+    }
+
+    void pgnIndexSidecar() {
+        const std::string path = (std::filesystem::temp_directory_path() / "chesscpp-regression.pgn").string();
+        {
+            std::ofstream pgn(path, std::ios::binary | std::ios::trunc);
+            pgn << "[White \"A\"]\n[Black \"B\"]\n[Result \"1-0\"]\n\n1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7# 1-0\n\n"
+                << "[White \"C\"]\n[Black \"D\"]\n[Result \"0-1\"]\n\n1. f3 e5 2. g4 Qh4# 0-1\n";
+        }
+        std::filesystem::remove(path + ".idx");
+        PgnIndex::build(path);
+        {
+            PgnIndex index(path);
+            check(index.fromSidecar() && index.size() == 2 && index.entry(1).white == "C", "PGN index read from its sidecar");
+        }
+
+        // A record pointing past the end of the PGN, then a truncated sidecar: both are rebuilt.
+        const uint64_t badOffset = ~0ULL;
+        {
+            std::fstream idx(path + ".idx", std::ios::binary | std::ios::in | std::ios::out);
+            idx.seekp(48);
+            idx.write(reinterpret_cast<const char*>(&badOffset), sizeof(badOffset));
+        }
+        {
+            PgnIndex index(path, false);
+            check(!index.fromSidecar() && index.size() == 2 && index.entry(0).white == "A", "PGN index with a corrupt record is rebuilt");
+        }
+        std::filesystem::resize_file(path + ".idx", std::filesystem::file_size(path + ".idx") - 3);
+        {
+            PgnIndex index(path);
+            check(!index.fromSidecar() && index.size() == 2 && index.text(1).find("Qh4#") != std::string::npos, "truncated PGN index sidecar is rebuilt");
+        }
+        std::filesystem::remove(path);
+        std::filesystem::remove(path + ".idx");
+    }
+}
+
+int main() {
+    perftCounts();
+    crowdedBoard();
+    hashedPerft();
+    perftStatistics();
+    sanRoundTrip();
+    pgnRoundTrip();
+    fenRoundTrip();
+    mateSearch();
+    tablebaseProbes();
+    binaryRoundTrip();
+    parallelImport();
+    moveRecords();
+    incrementalEvaluation();
+    zobristKeys();
+    pgnIndexSidecar();
+    polyglotKeys();
+
+    if (failures > 0) {
+        std::cout << failures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/chesscpp"
+
+using namespace ChessCpp;
+using namespace std::literals::chrono_literals;
+
+// A UCI engine on top of the library, for GUIs and match runners.
+// Besides the standard commands it understands "perft <depth>" (also as "go perft <depth>"),
+// which prints the count for each root move and the total.
+namespace {
+    const char* const STARTPOS = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    const int MAX_THREADS = 256;
+    const int MAX_HASH = 65536;
+
+    // The search thread reports while the main thread answers commands, so whole lines go out under a lock.
+    std::mutex outputMutex;
+
+    void say(const std::string& line) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << line << std::endl;
+    }
+
+    std::string lower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    }
+
+    class Engine {
+    public:
+        Engine() {
+            _stop = false;
+        }
+
+        ~Engine() {
+            _finish(true);
+        }
+
+        // Handles one line of input. Returns false on "quit".
+        bool command(const std::string& line);
+
+        // At the end of the input: a search with a depth, node or time limit is left to finish.
+        void close() {
+            _finish(!_bounded);
+        }
+
+    private:
+        Chess _game;
+        std::string _fen = STARTPOS;        // Position the current game was set up from.
+        std::vector<std::string> _moves;    // Moves played on it since, as received.
+        int _threads = 1;
+
+        std::thread _search;
+        std::atomic<bool> _stop;
+        bool _bounded = false;
+
+        void _finish(bool stop);
+        void _position(std::istringstream& in);
+        void _go(std::istringstream& in);
+        void _setOption(std::istringstream& in);
+        void _perft(int depth);
+        bool _playLan(const std::string& lan);
+    };
+
+    void Engine::_finish(bool stop) {
+        if (_search.joinable()) {
+            if (stop) _stop = true;
+            _search.join();
+        }
+    }
+
+    // UCI moves are in long algebraic notation already, so they are matched on their squares
+    // against the legal moves, without building or parsing SAN.
+    bool Engine::_playLan(const std::string& lan) {
+        if (lan.size() != 4 && lan.size() != 5) return false;
+        MoveOption option{ lan.substr(0, 2), lan.substr(2, 2), std::nullopt };
+        if (lan.size() == 5) option.promotion = lan.substr(4, 1);
+        try {
+            _game.playMove(option);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    void Engine::_position(std::istringstream& in) {
+        std::string token;
+        std::string fen;
+        in >> token;
+        if (token == "startpos") {
+            fen = STARTPOS;
+            in >> token;
+        }
+        else if (token == "fen") {
+            while (in >> token && token != "moves") {
+                fen += fen.empty() ? token : " " + token;
+            }
+        }
+        else {
+            return;
+        }
+
+        std::vector<std::string> moves;
+        while (in >> token) {
+            moves.push_back(token);
+        }
+
+        // GUIs resend the whole game before every move. When it extends the position we already
+        // have, only the new moves are played.
+        size_t played = 0;
+        if (fen == _fen && moves.size() >= _moves.size() && std::equal(_moves.begin(), _moves.end(), moves.begin())) {
+            played = _moves.size();
+        }
+        else {
+            try {
+                _game.load(fen);
+            }
+            catch (const std::exception& e) {
+                say(std::string("info string Invalid FEN: ") + e.what());
+                _game.load(STARTPOS);
+                fen = STARTPOS;
+                moves.clear();
+            }
+            _fen = fen;
+            _moves.clear();
+        }
+
+        for (size_t i = played; i < moves.size(); i++) {
+            if (!_playLan(moves[i])) {
+                say("info string Illegal move: " + moves[i]);
+                break;
+            }
+            _moves.push_back(moves[i]);
+        }
+    }
+
+    void Engine::_go(std::istringstream& in) {
+        SearchLimits limits;
+        bool infinite = false;
+        int64_t time[2] = { 0, 0 };
+        int64_t increment[2] = { 0, 0 };
+        int64_t movesToGo = 0;
+
+        std::string token;
+        while (in >> token) {
+            if (token == "perft") {
+                int depth = 0;
+                in >> depth;
+                _perft(depth);
+                return;
+            }
+            if (token == "infinite") infinite = true;
+            else if (token == "depth") in >> limits.depth;
+            else if (token == "nodes") in >> limits.nodes;
+            else if (token == "movetime") in >> limits.movetime;
+            else if (token == "wtime") in >> time[0];
+            else if (token == "btime") in >> time[1];
+            else if (token == "winc") in >> increment[0];
+            else if (token == "binc") in >> increment[1];
+            else if (token == "movestogo") in >> movesToGo;
+        }
+
+        // With a clock, spend an even share of the remaining time plus most of the increment,
+        // keeping a margin for the GUI's overhead.
+        const int side = _game.turn() == WHITE ? 0 : 1;
+        if (!infinite && limits.movetime == 0 && time[side] > 0) {
+            const int64_t share = time[side] / (movesToGo > 0 ? movesToGo : 30) + increment[side] * 3 / 4;
+            limits.movetime = std::max<int64_t>(1, std::min(share, time[side] - 50));
+        }
+
+        _bounded = !infinite && (limits.depth > 0 || limits.nodes > 0 || limits.movetime > 0);
+        limits.threads = _threads;
+        _stop = false;
+        limits.stop = &_stop;
+        limits.onIteration = [](const SearchResult& r) {
+            std::ostringstream info;
+            info << "info depth " << r.depth << " seldepth " << r.selDepth;
+            if (r.mate) {
+                info << " score mate " << r.mate.value();
+            }
+            else {
+                info << " score cp " << r.score;
+            }
+            info << " nodes " << r.nodes
+                << " nps " << (r.time > 0 ? r.nodes * 1000 / r.time : r.nodes)
+                << " hashfull " << r.hashfull
+                << " time " << r.time
+                << " pv";
+            for (const auto& m : r.pv) {
+                info << ' ' << m;
+            }
+            say(info.str());
+        };
+
+        _search = std::thread([this, limits, infinite]() {
+            const SearchResult result = _game.search(limits);
+            // "go infinite" must not answer before "stop", even when the search ran out of depth.
+            while (infinite && !_stop) {
+                std::this_thread::sleep_for(1ms);
+            }
+            say("bestmove " + (result.bestMove.empty() ? std::string("0000") : result.bestMove));
+        });
+    }
+
+    void Engine::_setOption(std::istringstream& in) {
+        std::string token;
+        std::string name;
+        std::string value;
+        in >> token;
+        if (token != "name") return;
+        while (in >> token && token != "value") {
+            name += name.empty() ? token : " " + token;
+        }
+        std::getline(in >> std::ws, value);
+        name = lower(name);
+
+        if (name == "hash") {
+            const int megabytes = std::max(1, std::min(MAX_HASH, std::atoi(value.c_str())));
+            _game.setHashSize(static_cast<size_t>(megabytes));
+        }
+        else if (name == "threads") {
+            _threads = std::max(1, std::min(MAX_THREADS, std::atoi(value.c_str())));
+        }
+        else if (name == "clear hash") {
+            _game.clearHash();
+        }
+        else {
+            say("info string Unknown option: " + name);
+        }
+    }
+
+    void Engine::_perft(int depth) {
+        const auto startTime = std::chrono::steady_clock::now();
+        std::ostringstream out;
+        uint64_t total = 0;
+        for (const auto& entry : _game.perftDivide(depth)) {
+            out << entry.first << ": " << entry.second << '\n';
+            total += entry.second;
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - startTime;
+        out << "\nNodes searched: " << total << "\nTime: " << elapsed / 1ms << " ms";
+        say(out.str());
+    }
+
+    bool Engine::command(const std::string& line) {
+        std::istringstream in(line);
+        std::string token;
+        if (!(in >> token)) return true;
+
+        if (token == "isready") {
+            say("readyok");
+            return true;
+        }
+        if (token == "stop" || token == "quit") {
+            _finish(true);
+            return token == "stop";
+        }
+        // Every other command needs the board. As at the end of the input, a search with a depth,
+        // node or time limit is left to finish and give its move; one without a limit is stopped.
+        _finish(!_bounded);
+
+        if (token == "uci") {
+            std::ostringstream out;
+            out << "id name chesscpp\n"
+                << "id author chesscpp contributors\n"
+                << "option name Hash type spin default 16 min 1 max " << MAX_HASH << '\n'
+                << "option name Threads type spin default 1 min 1 max " << MAX_THREADS << '\n'
+                << "option name Clear Hash type button\n"
+                << "uciok";
+            say(out.str());
+        }
+        else if (token == "ucinewgame") {
+            _game.clearHash();
+        }
+        else if (token == "position") {
+            _position(in);
+        }
+        else if (token == "go") {
+            _go(in);
+        }
+        else if (token == "setoption") {
+            _setOption(in);
+        }
+        else if (token == "perft") {
+            int depth = 0;
+            in >> depth;
+            _perft(depth);
+        }
+        else if (token == "d") {
+            say(_game.ascii() + "\nFen: " + _game.fen());
+        }
+        else {
+            say("info string Unknown command: " + token);
+        }
+        return true;
+    }
+}
+
+int main() {
+    std::ios::sync_with_stdio(false);
+    Engine engine;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (!engine.command(line)) return 0;
+    }
+    engine.close();
+    return 0;
+}